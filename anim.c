@@ -0,0 +1,131 @@
+#include "anim.h"
+#include "dim.h"
+#include "hal.h"
+#include "lights.h"
+
+// a keyframe, with the brightness of every light in light number order
+#define KEY(shift, up, k, s, b, one, two, three, four, five, down) \
+	shift, up << 4 | k, s << 4 | b, one << 4 | two, three << 4 | four, \
+	five << 4 | down
+
+static const uint8_t BOOT[] PROGMEM = {
+	//   up  k  s  b  1  2  3  4  5  down
+	KEY(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 15),
+	KEY(2, 0, 0, 0, 0, 15, 0, 0, 0, 0, 0),
+	KEY(2, 0, 0, 0, 0, 0, 15, 0, 0, 0, 0),
+	KEY(2, 0, 0, 0, 0, 0, 0, 15, 0, 0, 0),
+	KEY(2, 0, 0, 0, 0, 0, 0, 0, 15, 0, 0),
+	KEY(2, 0, 0, 0, 0, 0, 0, 0, 0, 15, 0),
+	KEY(2, 0, 0, 0, 15, 0, 0, 0, 0, 0, 0),
+	KEY(2, 0, 0, 15, 0, 0, 0, 0, 0, 0, 0),
+	KEY(2, 0, 15, 0, 0, 0, 0, 0, 0, 0, 0),
+	KEY(2, 15, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+	KEY(3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15),
+	KEY(5, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15),
+	KEY(4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+	ANIM_END
+};
+
+static const uint8_t PULSE[] PROGMEM = {
+	KEY(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+	KEY(4, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15),
+	KEY(4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+	ANIM_END
+};
+
+static const uint8_t *const ANIMS[ANIM_COUNT] = {BOOT, PULSE};
+
+// the animation, and the keyframe that the lights fade to
+static volatile enum anim playing = ANIM_COUNT;
+static const uint8_t *key;
+static uint16_t mask;
+static bool looping;
+
+// the fade: from `from` to `to` in 2^shift frames, of which `frame` are done
+static uint8_t from[LIGHT_COUNT], to[LIGHT_COUNT];
+static uint8_t shift, frame;
+
+
+// read the brightnesses of keyframe `k` into `to`
+static void load(const uint8_t *k)
+{
+	uint8_t light, byte = 0;
+
+	shift = pgm_read_byte(k);
+	for (light = 0; light < LIGHT_COUNT; light++) {
+		if (light % 2 == 0) {
+			byte = pgm_read_byte(k + 1 + light / 2);
+			to[light] = byte >> 4;
+		} else {
+			to[light] = byte & 0x0f;
+		}
+	}
+	frame = 0;
+}
+
+
+void anim_play(const enum anim anim, const uint16_t play_mask,
+               const bool loop)
+{
+	const bool irq = hal_irq_enabled();
+	uint8_t light;
+
+	hal_irq_disable();
+	playing = anim;
+	key = ANIMS[anim];
+	mask = play_mask;
+	looping = loop;
+	load(key);
+	for (light = 0; light < LIGHT_COUNT; light++) from[light] = to[light];
+	frame = 1 << shift;
+	dim_overlay(mask, to);
+	if (irq) hal_irq_enable();
+}
+
+
+void anim_stop(void)
+{
+	const bool irq = hal_irq_enabled();
+
+	hal_irq_disable();
+	playing = ANIM_COUNT;
+	dim_overlay(LIGHTS_NONE, NULL);
+	if (irq) hal_irq_enable();
+}
+
+
+enum anim anim_playing(void)
+{
+	return playing;
+}
+
+
+void anim_frame(void)
+{
+	uint8_t brightness[LIGHT_COUNT];
+	uint8_t light;
+
+	if (playing == ANIM_COUNT) return;
+
+	// on to the next keyframe
+	if (frame == 1 << shift) {
+		for (light = 0; light < LIGHT_COUNT; light++) from[light] = to[light];
+		key += ANIM_KEY_SIZE;
+		if (pgm_read_byte(key) == ANIM_END) {
+			if (!looping) {
+				playing = ANIM_COUNT;
+				dim_overlay(LIGHTS_NONE, NULL);
+				return;
+			}
+			key = ANIMS[playing];
+		}
+		load(key);
+	}
+
+	frame++;
+	for (light = 0; light < LIGHT_COUNT; light++) {
+		brightness[light] = (uint8_t) (from[light] +
+		    (((int16_t) to[light] - from[light]) * frame >> shift));
+	}
+	dim_overlay(mask, brightness);
+}
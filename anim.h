@@ -0,0 +1,48 @@
+#ifndef ANIM_H_
+#define ANIM_H_
+
+/*
+ * Keyframe animations
+ *
+ * An animation is a list of keyframes in PROGMEM, each of ANIM_KEY_SIZE
+ * bytes:
+ *
+ *     shift, brightness of lights 0 and 1, ..., of lights 8 and 9
+ *
+ * with two brightnesses (0 to DIM_MAX, see dim.h) per byte, the lower light
+ * number in the high nibble. From one keyframe the lights fade linearly to
+ * the next one in 2^shift animation frames. The first keyframe is where the
+ * animation starts, and ANIM_END after the last one ends it (or starts it
+ * over from the first keyframe).
+ *
+ * The Timer0 interrupt of dim.c calls anim_frame 32.6 times per second. A
+ * frame costs the same every time: a multiplication and a shift per light,
+ * and a few loads from PROGMEM when a new keyframe starts. Only the lights in
+ * the mask of anim_play are animated, the others keep showing dim_show.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ANIM_KEY_SIZE 6
+#define ANIM_END 0xff
+
+enum anim {
+	ANIM_BOOT,   // self-test: a light runs up the indicator, then all fade
+	ANIM_PULSE,  // fade in and out once per second, for announcements
+	ANIM_COUNT
+};
+
+// animate the lights in `mask` with `anim`, once or over and over again
+void anim_play(enum anim anim, uint16_t mask, bool loop);
+
+// stop the animation, and show the lights of dim_show again
+void anim_stop(void);
+
+// the animation that is playing, or ANIM_COUNT
+enum anim anim_playing(void);
+
+// from the Timer0 interrupt: the next frame
+void anim_frame(void);
+
+#endif /* ANIM_H_ */
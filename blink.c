@@ -0,0 +1,97 @@
+#include "blink.h"
+#include "lights.h"
+
+#define SLOTS_PER_OVERFLOW (256 / BLINK_COUNTS)
+
+#if BLINK_SLOTS != 4 * SLOTS_PER_OVERFLOW
+#error "the wheel must turn once every four Timer2 overflows"
+#endif
+
+struct blink_def {
+	uint8_t period, duty, phase; // in wheel ticks
+};
+
+// slots 0 and 16 start a second of the system time (see blink_overflow), so
+// a phase of 8 starts half way a second
+static const struct blink_def PATTERNS[BLINK_PATTERNS] PROGMEM = {
+	{16, 8, 8},   // BLINK_SLOW, like the flashing of the schedule used to
+	{4, 2, 0},    // BLINK_FAST
+	{16, 12, 0}   // BLINK_FIGURE
+};
+
+// the lights of every pattern, and the lights that are on in every slot
+static uint16_t masks[BLINK_PATTERNS];
+static uint16_t wheel[BLINK_SLOTS];
+
+// read by the interrupt handlers; `half` counts the half seconds of the
+// wheel, and is even in the first half of every second
+static uint16_t blinking = LIGHTS_NONE;
+static uint16_t hidden = LIGHTS_NONE;
+static uint8_t half = 0;
+
+
+void blink_set(const enum blink_pattern pattern, const uint16_t mask)
+{
+	const bool irq = hal_irq_enabled();
+	uint8_t slot, p, period, duty, phase;
+	uint16_t on, all = LIGHTS_NONE;
+
+	if (masks[pattern] == mask) return;
+	masks[pattern] = mask;
+
+	// slot by slot, to keep the interrupts waiting for a few cycles only
+	for (slot = 0; slot < BLINK_SLOTS; slot++) {
+		on = LIGHTS_NONE;
+		for (p = 0; p < BLINK_PATTERNS; p++) {
+			period = pgm_read_byte(&PATTERNS[p].period);
+			duty = pgm_read_byte(&PATTERNS[p].duty);
+			phase = pgm_read_byte(&PATTERNS[p].phase);
+			if ((uint8_t) (slot + BLINK_SLOTS - phase) % period < duty) {
+				on |= masks[p];
+			}
+		}
+		hal_irq_disable();
+		wheel[slot] = on;
+		if (irq) hal_irq_enable();
+	}
+	for (p = 0; p < BLINK_PATTERNS; p++) all |= masks[p];
+
+	hal_irq_disable();
+	blinking = all;
+	hidden &= all;
+	if (irq) hal_irq_enable();
+}
+
+
+bool blink_active(void)
+{
+	return blinking != LIGHTS_NONE;
+}
+
+
+void blink_overflow(const bool second)
+{
+	// follow the system time, whenever the first overflow came
+	if (second) {
+		half = (half + 2) & 2;
+	} else {
+		half |= 1;
+	}
+}
+
+
+bool blink_tick(const uint8_t count)
+{
+	const uint8_t slot = half * SLOTS_PER_OVERFLOW + count / BLINK_COUNTS;
+	const uint16_t off = blinking & ~wheel[slot];
+
+	if (off == hidden) return false;
+	hidden = off;
+	return true;
+}
+
+
+uint16_t blink_hidden(void)
+{
+	return hidden;
+}
@@ -0,0 +1,57 @@
+#ifndef BLINK_H_
+#define BLINK_H_
+
+/*
+ * Blink patterns
+ *
+ * Every light can blink in a pattern of its own: on for `duty` out of every
+ * `period` wheel ticks, from `phase` ticks into the period. Timer2 compare
+ * matches turn a wheel of BLINK_SLOTS slots at BLINK_HZ, in step with the
+ * Timer2 overflows that keep the time, and every slot holds the lights that
+ * are on in it. blink_set fills in the wheel whenever the patterns change,
+ * so a tick is one lookup, however many lights blink. The periods divide
+ * BLINK_SLOTS, which makes the wheel repeat every 2 seconds.
+ *
+ * The wheel ticks fall half way between the Timer2 compare grid points at
+ * counts 0, BLINK_COUNTS, ..., so that they never coincide with an overflow.
+ * A light only blinks while it is on in the light state; blink_hidden tells
+ * which ones are off in the current slot.
+ */
+
+#include "hal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLINK_HZ 16
+#define BLINK_SLOTS 32 /* 2 s */
+#define BLINK_COUNTS (HAL_TIMER2_HZ / BLINK_HZ)
+
+// the Timer2 count of the wheel ticks, modulo BLINK_COUNTS
+#define BLINK_TICK_COUNT (BLINK_COUNTS / 2)
+
+enum blink_pattern {
+	BLINK_SLOW,    // 1 Hz, half on: K flashing on the chain
+	BLINK_FAST,    // 4 Hz, half on: a block is about to begin
+	BLINK_FIGURE,  // 1 Hz, on for 3/4: the figures of the control mode
+	BLINK_PATTERNS
+};
+
+// blink the lights in `mask` in `pattern` from now on, instead of the
+// lights that did so far (a light in several patterns is on when either is)
+void blink_set(enum blink_pattern pattern, uint16_t mask);
+
+// does any light blink?
+bool blink_active(void);
+
+// call from TIMER2_OVF_vect, with `second` set when the system time ticks
+void blink_overflow(bool second);
+
+// call from TIMER2_COMP_vect at the wheel ticks, when the Timer2 counter is
+// at `count`; returns true if blink_hidden changed
+bool blink_tick(uint8_t count);
+
+// the blinking lights that are off in the current slot (call with
+// interrupts disabled)
+uint16_t blink_hidden(void);
+
+#endif /* BLINK_H_ */
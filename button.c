@@ -0,0 +1,119 @@
+#include "button.h"
+#include "event.h"
+#include "hal.h"
+#include "pins.h"
+#include "trace.h"
+
+#define SAMPLE_HZ (HAL_TIMER2_HZ / BUTTON_SAMPLE_COUNTS)
+#define LONG_PRESS_SAMPLES (LONG_PRESS_DURATION * SAMPLE_HZ / 1000)
+#define DOUBLE_PRESS_SAMPLES (DOUBLE_PRESS_WINDOW * SAMPLE_HZ / 1000)
+
+#if LONG_PRESS_SAMPLES > 255 || DOUBLE_PRESS_SAMPLES > 255
+#error "LONG_PRESS_DURATION and DOUBLE_PRESS_WINDOW must be below 4 seconds"
+#endif
+
+static enum {
+	IDLE,     // button up, nothing pending
+	PRESSED,  // button down, not long enough for a long press yet
+	HELD,     // long press was posted, waiting for the release
+	RELEASED  // button up after a short press, waiting for a second press
+} state = IDLE;
+
+// only accessed from interrupt handlers
+static bool sampling = false;
+static bool level = false;    // debounced level, true if down
+static uint8_t stable = 0;    // samples in a row that differ from `level`
+static uint8_t elapsed = 0;   // samples since the last press or release
+static bool second = false;   // the current press is the second one
+
+
+bool button_is_down()
+{
+	return (hal_io_read(CONTROL_BUTTON_PORT) & (1 << CONTROL_BUTTON_BIT)) != 0;
+}
+
+
+void button_edge()
+{
+	if (sampling) return;
+
+	// sample until the button has settled
+	hal_int0_enable(false);
+	sampling = true;
+	stable = 0;
+}
+
+
+bool button_sampling()
+{
+	return sampling;
+}
+
+
+// debounce one sample, returns true if `level` changed
+static bool debounce()
+{
+	if (button_is_down() == level) {
+		stable = 0;
+		return false;
+	}
+	if (++stable < BUTTON_DEBOUNCE_SAMPLES) return false;
+	stable = 0;
+	level = !level;
+	return true;
+}
+
+
+void button_sample()
+{
+	const bool changed = debounce();
+	const uint8_t before = state;
+
+	if (elapsed < 255) elapsed++;
+
+	switch (state) {
+		case IDLE:
+			if (changed && level) {
+				state = PRESSED;
+				elapsed = 0;
+				second = false;
+			}
+			break;
+		case PRESSED:
+			if (changed && !level) {
+				if (second) {
+					event_post(EVENT_DOUBLE_PRESS);
+					state = IDLE;
+				} else {
+					state = RELEASED;
+					elapsed = 0;
+				}
+			} else if (elapsed >= LONG_PRESS_SAMPLES) {
+				// a long second press still counts the first one
+				if (second) event_post(EVENT_SHORT_PRESS);
+				event_post(EVENT_LONG_PRESS);
+				state = HELD;
+			}
+			break;
+		case HELD:
+			if (changed && !level) state = IDLE;
+			break;
+		case RELEASED:
+			if (changed && level) {
+				state = PRESSED;
+				elapsed = 0;
+				second = true;
+			} else if (elapsed >= DOUBLE_PRESS_SAMPLES) {
+				event_post(EVENT_SHORT_PRESS);
+				state = IDLE;
+			}
+			break;
+	}
+	if (state != before) trace(TRACE_BUTTON, state);
+
+	if (state == IDLE && !level && stable == 0) {
+		// done, wait for the next edge
+		sampling = false;
+		hal_int0_enable(true);
+	}
+}
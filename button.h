@@ -0,0 +1,42 @@
+#ifndef BUTTON_H_
+#define BUTTON_H_
+
+/*
+ * CONTROL button gestures
+ *
+ * An edge on INT0 starts sampling the button on the Timer2 compare matches,
+ * which main.c runs every BUTTON_SAMPLE_COUNTS Timer2 counts while the button
+ * is sampled. A new level counts once it has been seen in
+ * BUTTON_DEBOUNCE_SAMPLES samples in a row. The press and release times then
+ * give short, long and double presses, which are posted to the event queue
+ * (see event.h). When the button is released and no gesture is pending,
+ * sampling stops and INT0 is armed again, so an idle button costs nothing.
+ */
+
+#include <stdbool.h>
+
+#ifndef LONG_PRESS_DURATION
+#define LONG_PRESS_DURATION 1000 /* ms */
+#endif /* LONG_PRESS_DURATION */
+
+// a second press within this time after a short press makes a double press
+#ifndef DOUBLE_PRESS_WINDOW
+#define DOUBLE_PRESS_WINDOW 400 /* ms */
+#endif /* DOUBLE_PRESS_WINDOW */
+
+#define BUTTON_SAMPLE_COUNTS 8 /* 15.6 ms */
+#define BUTTON_DEBOUNCE_SAMPLES 2
+
+// is the CONTROL button down right now (not debounced)?
+bool button_is_down();
+
+// call from INT0_vect
+void button_edge();
+
+// is the button being sampled?
+bool button_sampling();
+
+// call from TIMER2_COMP_vect while button_sampling()
+void button_sample();
+
+#endif /* BUTTON_H_ */
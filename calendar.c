@@ -0,0 +1,27 @@
+#include "calendar.h"
+#include "calendar_table.h"
+#include "hal.h"
+#include <time.h>
+
+#if CALENDAR_YEARS > 0
+static const uint8_t CALENDAR[CALENDAR_YEARS][CALENDAR_YEAR_SIZE] PROGMEM =
+	CALENDAR_TABLE;
+#endif /* CALENDAR_YEARS > 0 */
+
+
+enum calendar_class calendar_class(int16_t year, int16_t yday,
+                                   const int8_t wday)
+{
+	if (yday < 0) {
+		year--;
+		yday = 364 + is_leap_year(1900 + year);
+	}
+#if CALENDAR_YEARS > 0
+	year -= CALENDAR_FIRST_YEAR - 1900;
+	if (year >= 0 && year < CALENDAR_YEARS) {
+		return pgm_read_byte(&CALENDAR[year][yday / 4]) >> 2 * (yday % 4) & 3;
+	}
+#endif /* CALENDAR_YEARS > 0 */
+	return (wday == SUNDAY || wday == SATURDAY) ? CALENDAR_WEEKEND :
+	                                              CALENDAR_LECTURE;
+}
@@ -0,0 +1,31 @@
+#ifndef CALENDAR_H_
+#define CALENDAR_H_
+
+/*
+ * Academic calendar
+ *
+ * Every day of a year has one of four classes, at 2 bits per day: day `yday`
+ * is bits 2 * (yday % 4) and up of byte yday / 4, so a year takes
+ * CALENDAR_YEAR_SIZE bytes. tools/mkcalendar compiles calendar.txt into such
+ * a table in flash, for the years from CALENDAR_FIRST_YEAR on. Outside those
+ * years Monday to Friday are lecture days and the rest is weekend.
+ *
+ * Schedule rules can be limited to some classes of days (see schedule.h).
+ */
+
+#include <stdint.h>
+
+#define CALENDAR_YEAR_SIZE 92
+
+enum calendar_class {
+	CALENDAR_LECTURE = 0,
+	CALENDAR_WEEKEND = 1,
+	CALENDAR_HOLIDAY = 2,
+	CALENDAR_EXAMS = 3
+};
+
+// the class of day `yday` of `year` (like in struct tm), which is weekday
+// `wday`; a `yday` of -1 is the last day of the year before
+enum calendar_class calendar_class(int16_t year, int16_t yday, int8_t wday);
+
+#endif /* CALENDAR_H_ */
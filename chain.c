@@ -0,0 +1,49 @@
+#include "chain.h"
+
+#ifdef LIGHTS_CHAIN
+
+#include "hal.h"
+#include "pins.h"
+#include <stdbool.h>
+
+// the frame that the registers show
+static uint16_t shown[LIGHTS_CHAIN];
+static bool shown_valid = false;
+
+
+void chain_init(void)
+{
+	static const uint16_t OFF[LIGHTS_CHAIN];
+
+	hal_io_output(HAL_PORTB, (1 << SPI_MOSI_BIT) | (1 << SPI_SCK_BIT));
+	hal_io_output(CHAIN_LATCH_PORT, 1 << CHAIN_LATCH_BIT);
+	hal_io_write(CHAIN_LATCH_PORT, 1 << CHAIN_LATCH_BIT, 0x00);
+	hal_spi_init();
+	shown_valid = false;
+	chain_write(OFF);
+}
+
+
+void chain_write(const uint16_t lights[LIGHTS_CHAIN])
+{
+	uint8_t i;
+
+	if (shown_valid) {
+		for (i = 0; i < LIGHTS_CHAIN && lights[i] == shown[i]; i++) {}
+		if (i == LIGHTS_CHAIN) return;
+	}
+
+	// the bits that go in first end up furthest away
+	for (i = LIGHTS_CHAIN; i-- > 0;) {
+		hal_spi_write((uint8_t) (lights[i] >> 8));
+		hal_spi_write((uint8_t) lights[i]);
+		shown[i] = lights[i];
+	}
+	shown_valid = true;
+
+	// a rising edge copies the shift registers to the outputs
+	hal_io_write(CHAIN_LATCH_PORT, 1 << CHAIN_LATCH_BIT, 0xff);
+	hal_io_write(CHAIN_LATCH_PORT, 1 << CHAIN_LATCH_BIT, 0x00);
+}
+
+#endif /* LIGHTS_CHAIN */
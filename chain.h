@@ -0,0 +1,39 @@
+#ifndef CHAIN_H_
+#define CHAIN_H_
+
+/*
+ * Lights on a chain of shift registers (build with -DLIGHTS_CHAIN=N)
+ *
+ * Instead of the pins in pins.h, the lights of N indicators are driven by a
+ * daisy chain of 74HC595 (or TPIC6B595) shift registers, two per indicator,
+ * on the hardware SPI:
+ *
+ *     MOSI (PB3) -> SER of the first register, QH' -> SER of the next one
+ *     SCK (PB5)  -> SRCK of all registers
+ *     LATCH      -> RCK of all registers (see pins.h)
+ *
+ * Light n of an indicator is on output n of its first register (Q0..Q7),
+ * and then of its second (Q0, Q1). Indicator 0 is the one closest to the
+ * controller. The new frame is shifted in completely before the latch
+ * copies it to the outputs, so the lights never show a half-shifted frame.
+ *
+ * A frame is only shifted out when it differs from the last one. At
+ * F_CPU / 2 a byte takes 16 cycles, so ten indicators take about 0.4 ms.
+ *
+ * The SPI pins are the pins of lights S, B and TWO, so the lights of the
+ * controller's own ports are not used in this build.
+ */
+
+#include <stdint.h>
+
+#ifdef LIGHTS_CHAIN
+
+// start the SPI, and turn all lights off
+void chain_init(void);
+
+// show light state lights[i] on indicator i
+void chain_write(const uint16_t lights[LIGHTS_CHAIN]);
+
+#endif /* LIGHTS_CHAIN */
+
+#endif /* CHAIN_H_ */
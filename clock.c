@@ -0,0 +1,101 @@
+#include "clock.h"
+#include <stddef.h>
+
+// catching up more seconds than this is done with a full conversion
+#define MAX_CATCH_UP_TICKS 60
+
+static struct tm local_tm;
+static time_t local_now = 0; // the system time that `local_tm` shows
+static uint32_t utc_day_sec = 0;
+static int32_t utc_offset = 0;
+static int (*dst_ptr)(const time_t *, int32_t *) = NULL;
+
+
+void clock_init(int32_t zone, int (*dst)(const time_t *, int32_t *))
+{
+	utc_offset = zone;
+	dst_ptr = dst;
+	set_zone(zone);
+	set_dst(dst);
+}
+
+
+// do the full (slow) conversion of `timer`
+static void clock_sync(time_t timer)
+{
+	localtime_r(&timer, &local_tm);
+	utc_day_sec = timer % ONE_DAY;
+	local_now = timer;
+}
+
+
+void clock_set(time_t timer)
+{
+	set_system_time(timer);
+	clock_sync(timer);
+}
+
+
+void clock_tick(void)
+{
+	time_t now;
+
+	local_now++;
+	if (++utc_day_sec == ONE_DAY) utc_day_sec = 0;
+
+	if (++local_tm.tm_sec < 60) return;
+	local_tm.tm_sec = 0;
+
+	// DST only starts or ends on a full minute
+	if (dst_ptr != NULL) {
+		now = local_now;
+		if (dst_ptr(&now, &utc_offset) != local_tm.tm_isdst) {
+			clock_sync(now);
+			return;
+		}
+	}
+
+	if (++local_tm.tm_min < 60) return;
+	local_tm.tm_min = 0;
+
+	if (++local_tm.tm_hour < 24) return;
+	local_tm.tm_hour = 0;
+	if (++local_tm.tm_wday == 7) local_tm.tm_wday = SUNDAY;
+	local_tm.tm_yday++;
+	if (++local_tm.tm_mday <= month_length(1900 + local_tm.tm_year,
+	                                       local_tm.tm_mon + 1)) {
+		return;
+	}
+	local_tm.tm_mday = 1;
+	if (++local_tm.tm_mon < 12) return;
+	local_tm.tm_mon = JANUARY;
+	local_tm.tm_yday = 0;
+	local_tm.tm_year++;
+}
+
+
+uint32_t clock_update(void)
+{
+	const time_t now = time(NULL);
+	const uint32_t seconds = now - local_now;
+	uint32_t i;
+
+	if (seconds > MAX_CATCH_UP_TICKS) {
+		clock_sync(now);
+	} else {
+		for (i = 0; i < seconds; i++) clock_tick();
+	}
+	return seconds;
+}
+
+
+const struct tm *clock_local(void)
+{
+	return &local_tm;
+}
+
+
+uint32_t clock_utc_day_sec(void)
+{
+	return utc_day_sec;
+}
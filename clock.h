@@ -0,0 +1,37 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+/*
+ * Wall clock
+ *
+ * Keeps the broken-down local time next to avr-libc's system time, so that
+ * we do not have to convert the timestamp on every tick. The clock is
+ * advanced one second at a time, and only falls back to `localtime_r` when
+ * the DST offset changes, when the time is set or when it has to catch up
+ * after a long sleep. The DST function is called once a minute, so it should
+ * be cheap (like `tz_dst`).
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+// set the time zone and DST function (see avr-libc's set_zone/set_dst)
+void clock_init(int32_t zone, int (*dst)(const time_t *, int32_t *));
+
+// set the system time and the wall clock to `timer`
+void clock_set(time_t timer);
+
+// advance the clock one second
+void clock_tick(void);
+
+// advance the clock to the system time, returns the number of seconds that
+// passed since the last update
+uint32_t clock_update(void);
+
+// current local time
+const struct tm *clock_local(void);
+
+// seconds since midnight UTC
+uint32_t clock_utc_day_sec(void);
+
+#endif /* CLOCK_H_ */
@@ -0,0 +1,18 @@
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <stdint.h>
+
+// CRC-16/CCITT-FALSE: start with 0xffff, polynomial 0x1021
+static inline uint16_t crc16_update(uint16_t crc, const uint8_t data)
+{
+	uint8_t i;
+
+	crc ^= (uint16_t) data << 8;
+	for (i = 0; i < 8; i++) {
+		crc = (crc & 0x8000) ? (uint16_t) (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+#endif /* CRC16_H_ */
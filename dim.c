@@ -0,0 +1,183 @@
+#include "dim.h"
+#include "anim.h"
+#include "hal.h"
+#include "lights.h"
+#include "profile.h"
+#include <string.h>
+
+// the duty cycle of every brightness: round(15 (b / 15)^2.2), but at least 1
+// for b > 0
+static const uint8_t GAMMA[DIM_MAX + 1] PROGMEM = {
+	0, 1, 1, 1, 1, 1, 2, 3, 4, 5, 6, 8, 9, 11, 13, 15
+};
+
+// the lights from dim_show and from dim_overlay, and from dim_hide
+static uint16_t base_lights = LIGHTS_NONE, overlay_mask = LIGHTS_NONE;
+static uint8_t base_brightness[LIGHT_COUNT], overlay_brightness[LIGHT_COUNT];
+static uint16_t hidden = LIGHTS_NONE;
+
+// the lights that are fully on when Timer0 is stopped, hidden or not
+static uint16_t flat_lights = LIGHTS_NONE;
+
+// the port values of every plane (indexed by enum hal_port)
+static uint8_t planes[DIM_PLANES][3];
+static volatile uint8_t plane = 0, frames = 0;
+static bool active = false;
+
+
+static void write_ports(const uint8_t values[3])
+{
+	if (lights_port_mask(HAL_PORTB) != 0) {
+		hal_io_write(HAL_PORTB, lights_port_mask(HAL_PORTB), values[HAL_PORTB]);
+	}
+	if (lights_port_mask(HAL_PORTC) != 0) {
+		hal_io_write(HAL_PORTC, lights_port_mask(HAL_PORTC), values[HAL_PORTC]);
+	}
+	if (lights_port_mask(HAL_PORTD) != 0) {
+		hal_io_write(HAL_PORTD, lights_port_mask(HAL_PORTD), values[HAL_PORTD]);
+	}
+}
+
+
+// show `lights` fully on, but for the hidden ones
+static void write_full(const uint16_t lights)
+{
+	const uint16_t shown = lights & ~hidden;
+	const uint8_t values[3] = {
+		lights_port_value(HAL_PORTB, shown),
+		lights_port_value(HAL_PORTC, shown),
+		lights_port_value(HAL_PORTD, shown)
+	};
+
+	write_ports(values);
+}
+
+
+// while Timer0 runs, the next overflow shows the new planes (within a
+// plane, so the dimmed lights do not flash fully on); only the simulator
+// shows `lights` fully on, because it has no Timer0
+static void preview(const uint16_t lights)
+{
+	const uint16_t shown = lights & ~hidden;
+	uint8_t port;
+
+	for (port = HAL_PORTB; port <= HAL_PORTD; port++) {
+		if (lights_port_mask(port) != 0) {
+			hal_timer0_preview(port, lights_port_mask(port),
+			                   lights_port_value(port, shown));
+		}
+	}
+}
+
+
+// work out the planes, and start Timer0 if they differ (or an animation
+// needs its frames) or else stop it and show the lights
+static void update(void)
+{
+	uint16_t on[DIM_PLANES] = {LIGHTS_NONE};
+	uint8_t light, duty, p;
+	bool flat = true;
+
+	for (light = 0; light < LIGHT_COUNT; light++) {
+		if ((overlay_mask & (1 << light)) != 0) {
+			duty = pgm_read_byte(&GAMMA[overlay_brightness[light]]);
+		} else if ((base_lights & (1 << light)) != 0) {
+			duty = pgm_read_byte(&GAMMA[base_brightness[light]]);
+		} else {
+			continue;
+		}
+		for (p = 0; p < DIM_PLANES; p++) {
+			if ((duty & (1 << p)) != 0) on[p] |= 1 << light;
+		}
+	}
+	for (p = 0; p < DIM_PLANES; p++) flat &= (on[p] == on[0]);
+	flat_lights = on[0];
+	for (p = 0; p < DIM_PLANES; p++) {
+		on[p] &= ~hidden;
+		planes[p][HAL_PORTB] = lights_port_value(HAL_PORTB, on[p]);
+		planes[p][HAL_PORTC] = lights_port_value(HAL_PORTC, on[p]);
+		planes[p][HAL_PORTD] = lights_port_value(HAL_PORTD, on[p]);
+	}
+
+	if (flat && overlay_mask == LIGHTS_NONE) {
+		if (active) hal_timer0_stop();
+		active = false;
+		write_ports(planes[0]);
+	} else if (!active) {
+		// the first frame starts at the next overflow
+		plane = 0;
+		frames = 0;
+		active = true;
+		hal_timer0_start();
+	}
+}
+
+
+void dim_show(const uint16_t lights, const uint8_t *brightness)
+{
+	const bool irq = hal_irq_enabled();
+
+	// keep the interrupts out while the planes change
+	hal_irq_disable();
+	base_lights = lights;
+	if (brightness != NULL) {
+		memcpy(base_brightness, brightness, sizeof(base_brightness));
+	} else {
+		memset(base_brightness, DIM_MAX, sizeof(base_brightness));
+	}
+	update();
+	if (active) preview(lights);
+	if (irq) hal_irq_enable();
+}
+
+
+void dim_overlay(const uint16_t mask, const uint8_t *brightness)
+{
+	overlay_mask = mask;
+	if (brightness != NULL) {
+		memcpy(overlay_brightness, brightness, sizeof(overlay_brightness));
+	}
+	update();
+}
+
+
+void dim_hide(const uint16_t mask)
+{
+	hidden = mask;
+	if (active) {
+		update();
+		preview(base_lights);
+	} else {
+		write_full(flat_lights);
+	}
+}
+
+
+bool dim_active(void)
+{
+	return active;
+}
+
+
+// show the next plane, for 2^p units
+ISR(TIMER0_OVF_vect)
+{
+	const uint16_t start = profile_start();
+	const uint8_t p = plane;
+
+	write_ports(planes[p]);
+	hal_timer0_next(DIM_UNIT << p);
+	if (p + 1 < DIM_PLANES) {
+		plane = p + 1;
+	} else {
+		plane = 0;
+
+		// the longest plane leaves time for the next frame of the
+		// animation
+		if (++frames == DIM_ANIM_FRAMES) {
+			frames = 0;
+			anim_frame();
+		}
+	}
+	profile_end(PROFILE_TIMER0_OVF, start);
+}
@@ -0,0 +1,50 @@
+#ifndef DIM_H_
+#define DIM_H_
+
+/*
+ * Dimming by bit angle modulation
+ *
+ * Every light has a brightness from 0 (off) to DIM_MAX, which GAMMA in dim.c
+ * maps onto a duty cycle of 0 to 15 sixteenths. Timer0 cuts a frame into
+ * DIM_PLANES bit planes: plane p lasts DIM_UNIT << p counts and shows the
+ * lights whose duty cycle has bit p set. The port values of every plane are
+ * worked out whenever the lights change, so the Timer0 interrupt only writes
+ * them out, and costs the same for one dimmed light as for all of them.
+ *
+ * With DIM_UNIT 16 at F_CPU / 8 a frame takes 1.9 ms (520 Hz), with four
+ * interrupts per frame. Every DIM_ANIM_FRAMES frames the interrupt also
+ * advances the animation (see anim.h), which may cover some lights with its
+ * own brightness. When nothing is dimmed or animated, Timer0 is stopped and
+ * the ports are written once. dim_hide switches lights off on top of all
+ * that, for the blink patterns (see blink.h); while Timer0 is stopped, that
+ * only writes the ports. While it runs, new lights show from the next
+ * overflow on, within a plane.
+ *
+ * Timer0 stops in power-save mode, so do not use that while dim_active().
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DIM_PLANES 4
+#define DIM_MAX 15
+#define DIM_UNIT 16 /* Timer0 counts */
+#define DIM_ANIM_FRAMES 16 /* 32.6 Hz */
+
+// show light state `lights`, where light n has brightness `brightness[n]`
+// (or all DIM_MAX if `brightness` is NULL)
+void dim_show(uint16_t lights, const uint8_t *brightness);
+
+// show the lights in `mask` with `brightness` instead, whether they are on
+// or not (an empty mask shows the lights of dim_show again); call with
+// interrupts disabled
+void dim_overlay(uint16_t mask, const uint8_t *brightness);
+
+// show the lights in `mask` as off, whatever dim_show and dim_overlay say;
+// call with interrupts disabled
+void dim_hide(uint16_t mask);
+
+// is Timer0 running the bit planes?
+bool dim_active(void);
+
+#endif /* DIM_H_ */
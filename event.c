@@ -0,0 +1,34 @@
+#include "event.h"
+
+#define QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+#if (EVENT_QUEUE_SIZE & QUEUE_MASK) != 0 || EVENT_QUEUE_SIZE > 256
+#error "EVENT_QUEUE_SIZE must be a power of two, at most 256"
+#endif
+
+// the interrupt handlers write at `head`, the main loop reads at `tail`
+static volatile uint8_t queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t head = 0, tail = 0;
+
+bool event_post(enum event event)
+{
+	const uint8_t next = (head + 1) & QUEUE_MASK;
+
+	if (next == tail) return false;
+	queue[head] = event;
+	head = next;
+	return true;
+}
+
+bool event_take(enum event *event)
+{
+	if (tail == head) return false;
+	*event = queue[tail];
+	tail = (tail + 1) & QUEUE_MASK;
+	return true;
+}
+
+bool event_pending()
+{
+	return tail != head;
+}
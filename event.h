@@ -0,0 +1,40 @@
+#ifndef EVENT_H_
+#define EVENT_H_
+
+/*
+ * Event queue from the interrupt handlers to the main loop
+ *
+ * The interrupt handlers post events, the main loop takes them out with
+ * interrupts enabled. Interrupt handlers do not nest, so together they are a
+ * single producer, and the main loop is the single consumer. Each side only
+ * writes its own (byte-sized) index, which makes the queue safe without
+ * disabling interrupts.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 16
+#endif /* EVENT_QUEUE_SIZE */
+
+enum event {
+	EVENT_SECOND,       // Timer2 overflow on a whole second
+	EVENT_HALF_SECOND,  // Timer2 overflow half way a second
+	EVENT_SHORT_PRESS,  // the CONTROL button was pressed shortly
+	EVENT_LONG_PRESS,   // the CONTROL button is being held down
+	EVENT_DOUBLE_PRESS, // the CONTROL button was pressed twice shortly
+	EVENT_POWER_FAIL    // the supply is failing (see ENABLE_POWER_FAIL)
+};
+
+// add an event, only call this from an interrupt handler
+// returns false (and loses the event) when the queue is full
+bool event_post(enum event event);
+
+// take the oldest event, returns false if there is none
+bool event_take(enum event *event);
+
+// are there events waiting?
+bool event_pending();
+
+#endif /* EVENT_H_ */
@@ -0,0 +1,47 @@
+#ifndef HAL_H_
+#define HAL_H_
+
+/*
+ * Hardware abstraction layer
+ *
+ * The firmware only touches the hardware through the functions and macros in
+ * this header. On the target they are thin inline wrappers around the
+ * registers of the ATmega8 or one of its successors (see `hal_avr.h`). When
+ * building with HOST_SIM they are implemented by the simulator in `sim/`,
+ * which lets us run `main.c` on a normal computer.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// I/O ports that we use
+enum hal_port {
+	HAL_PORTB, HAL_PORTC, HAL_PORTD
+};
+
+// sleep modes, see hal_sleep_mode()
+enum hal_sleep_mode {
+	HAL_SLEEP_IDLE,       // everything but the CPU keeps running
+	HAL_SLEEP_POWER_SAVE  // only Timer2 keeps running
+};
+
+// peripherals that hal_power_off() can switch off
+enum hal_peripheral {
+	HAL_POWER_ADC = 1 << 0,
+	HAL_POWER_COMPARATOR = 1 << 1,
+	HAL_POWER_TWI = 1 << 2,
+	HAL_POWER_SPI = 1 << 3,
+	HAL_POWER_TIMER0 = 1 << 4,
+	HAL_POWER_TIMER1 = 1 << 5
+};
+
+// Timer2 counts at 32768 Hz / 64 and overflows every 256 counts (0.5 s)
+#define HAL_TIMER2_HZ 512
+
+#ifdef HOST_SIM
+#include "sim/hal_sim.h"
+#else /* HOST_SIM */
+#include "hal_avr.h"
+#endif /* HOST_SIM */
+
+#endif /* HAL_H_ */
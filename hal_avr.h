@@ -0,0 +1,613 @@
+#ifndef HAL_AVR_H_
+#define HAL_AVR_H_
+
+/*
+ * AVR implementation of the hardware abstraction layer (see hal.h)
+ *
+ * Written for the ATmega8. The pin compatible ATmega88, ATmega168 and
+ * ATmega328P (HAL_MEGA_X8) renamed many registers and bits and split the
+ * timer registers per timer, which the register names below map. They can
+ * also power down peripherals and divide the system clock, which
+ * hal_power_off and hal_clock_init use.
+ */
+
+#ifndef F_CPU
+#define F_CPU 1000000L
+#endif /* F_CPU */
+
+#include <avr/cpufunc.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+
+// RAM that the C runtime does not clear, so it survives a reset
+#define NOINIT __attribute__((section(".noinit")))
+
+
+/* REGISTER NAMES */
+
+#if defined(__AVR_ATmega88__) || defined(__AVR_ATmega88P__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || \
+    defined(__AVR_ATmega328P__)
+#define HAL_MEGA_X8
+#include <avr/power.h>
+#elif !defined(__AVR_ATmega8__)
+#error "unsupported MCU, see hal_avr.h"
+#endif
+
+#ifdef HAL_MEGA_X8
+// the USART
+#define HAL_UCSRA UCSR0A
+#define HAL_UCSRB UCSR0B
+#define HAL_UCSRC UCSR0C
+#define HAL_UBRRH UBRR0H
+#define HAL_UBRRL UBRR0L
+#define HAL_UDR UDR0
+#define HAL_U2X U2X0
+#define HAL_TXEN TXEN0
+#define HAL_RXEN RXEN0
+#define HAL_RXCIE RXCIE0
+#define HAL_UDRIE UDRIE0
+#define HAL_UDRE UDRE0
+#define HAL_TXC TXC0
+#define HAL_FE FE0
+#define HAL_DOR DOR0
+#define HAL_USBS USBS0
+#define HAL_UCSZ0 UCSZ00
+#define HAL_URSEL 0 // UCSR0C has its own address
+// the timers (Timer2 compare match is its match A)
+#define HAL_TCCR0 TCCR0B
+#define HAL_TCCR2 TCCR2B
+#define HAL_TIMSK0 TIMSK0
+#define HAL_TIMSK2 TIMSK2
+#define HAL_TIFR2 TIFR2
+#define HAL_OCR2 OCR2A
+#define HAL_OCF2 OCF2A
+#define HAL_OCIE2 OCIE2A
+#define HAL_TCR2UB TCR2BUB
+#define HAL_OCR2UB OCR2AUB
+// INT0 and the sleep modes
+#define HAL_EICR EICRA
+#define HAL_EIMSK EIMSK
+#define HAL_SMCR SMCR
+// the EEPROM
+#define HAL_EEMWE EEMPE
+#define HAL_EEWE EEPE
+// the interrupt vectors
+#define TIMER2_COMP_vect TIMER2_COMPA_vect
+#define USART_RXC_vect USART_RX_vect
+#define EE_RDY_vect EE_READY_vect
+#define ANA_COMP_vect ANALOG_COMP_vect
+#else /* HAL_MEGA_X8 */
+#define HAL_UCSRA UCSRA
+#define HAL_UCSRB UCSRB
+#define HAL_UCSRC UCSRC
+#define HAL_UBRRH UBRRH
+#define HAL_UBRRL UBRRL
+#define HAL_UDR UDR
+#define HAL_U2X U2X
+#define HAL_TXEN TXEN
+#define HAL_RXEN RXEN
+#define HAL_RXCIE RXCIE
+#define HAL_UDRIE UDRIE
+#define HAL_UDRE UDRE
+#define HAL_TXC TXC
+#define HAL_FE FE
+#define HAL_DOR DOR
+#define HAL_USBS USBS
+#define HAL_UCSZ0 UCSZ0
+#define HAL_URSEL (1 << URSEL) // UCSRC shares its address with UBRRH
+#define HAL_TCCR0 TCCR0
+#define HAL_TCCR2 TCCR2
+#define HAL_TIMSK0 TIMSK
+#define HAL_TIMSK2 TIMSK
+#define HAL_TIFR2 TIFR
+#define HAL_OCR2 OCR2
+#define HAL_OCF2 OCF2
+#define HAL_OCIE2 OCIE2
+#define HAL_TCR2UB TCR2UB
+#define HAL_OCR2UB OCR2UB
+#define HAL_EICR MCUCR
+#define HAL_EIMSK GICR
+#define HAL_SMCR MCUCR
+#define HAL_EEMWE EEMWE
+#define HAL_EEWE EEWE
+#endif /* HAL_MEGA_X8 */
+
+
+/* CLOCK AND POWER */
+
+#ifdef HAL_MEGA_X8
+// the division of the internal 8 MHz RC oscillator that gives F_CPU
+#if F_CPU == 8000000L
+#define HAL_CLOCK_DIV clock_div_1
+#elif F_CPU == 4000000L
+#define HAL_CLOCK_DIV clock_div_2
+#elif F_CPU == 2000000L
+#define HAL_CLOCK_DIV clock_div_4
+#elif F_CPU == 1000000L
+#define HAL_CLOCK_DIV clock_div_8
+#else
+#error "F_CPU must be 8 MHz divided by 1, 2, 4 or 8"
+#endif
+#endif /* HAL_MEGA_X8 */
+
+
+// run the CPU at F_CPU; the ATmega8 gets it from its fuses, the others from
+// the internal RC oscillator whatever their CKDIV8 fuse says
+static inline void hal_clock_init()
+{
+#ifdef HAL_MEGA_X8
+	clock_prescale_set(HAL_CLOCK_DIV);
+#endif /* HAL_MEGA_X8 */
+}
+
+
+// switch off the peripherals in `mask` (of enum hal_peripheral) for good;
+// the ATmega8 can only switch off the ADC and the analog comparator
+static inline void hal_power_off(const uint8_t mask)
+{
+	if (mask & HAL_POWER_ADC) ADCSRA = 0; // before it loses its clock
+	if (mask & HAL_POWER_COMPARATOR) ACSR = 1 << ACD;
+#ifdef HAL_MEGA_X8
+	if (mask & HAL_POWER_ADC) power_adc_disable();
+	if (mask & HAL_POWER_TWI) power_twi_disable();
+	if (mask & HAL_POWER_SPI) power_spi_disable();
+	if (mask & HAL_POWER_TIMER0) power_timer0_disable();
+	if (mask & HAL_POWER_TIMER1) power_timer1_disable();
+#endif /* HAL_MEGA_X8 */
+}
+
+
+/* GENERAL PURPOSE I/O */
+
+static inline volatile uint8_t *hal_ddr_reg(const enum hal_port port)
+{
+	switch (port) {
+		case HAL_PORTB: return &DDRB;
+		case HAL_PORTC: return &DDRC;
+		default:        return &DDRD;
+	}
+}
+
+
+static inline volatile uint8_t *hal_port_reg(const enum hal_port port)
+{
+	switch (port) {
+		case HAL_PORTB: return &PORTB;
+		case HAL_PORTC: return &PORTC;
+		default:        return &PORTD;
+	}
+}
+
+
+static inline volatile uint8_t *hal_pin_reg(const enum hal_port port)
+{
+	switch (port) {
+		case HAL_PORTB: return &PINB;
+		case HAL_PORTC: return &PINC;
+		default:        return &PIND;
+	}
+}
+
+
+// configure the pins in `mask` as outputs
+static inline void hal_io_output(const enum hal_port port, const uint8_t mask)
+{
+	*hal_ddr_reg(port) |= mask;
+	_NOP(); // for synchronization
+}
+
+
+// configure the pins in `mask` as inputs
+static inline void hal_io_input(const enum hal_port port, const uint8_t mask)
+{
+	*hal_ddr_reg(port) &= (uint8_t) ~mask;
+	_NOP(); // for synchronization
+}
+
+
+// write `value` to the pins in `mask`, leaving the other pins alone
+static inline void hal_io_write(const enum hal_port port, const uint8_t mask,
+                                const uint8_t value)
+{
+	volatile uint8_t *reg = hal_port_reg(port);
+	*reg = (uint8_t) (*reg & ~mask) | (value & mask);
+}
+
+
+static inline uint8_t hal_io_read(const enum hal_port port)
+{
+	return *hal_pin_reg(port);
+}
+
+
+/* UART */
+
+static inline void hal_uart_init()
+{
+	// Set double speed mode
+	HAL_UCSRA |= (1 << HAL_U2X);
+
+	// Set baud rate to 9600
+	HAL_UBRRH = 0;
+	HAL_UBRRL = 12;
+
+	// Enable transmissions, and receptions with the RXC interrupt
+	HAL_UCSRB = (1 << HAL_TXEN) | (1 << HAL_RXEN) | (1 << HAL_RXCIE);
+
+	// Set frame format
+	HAL_UCSRC = HAL_URSEL|(1<<HAL_USBS)|(3<<HAL_UCSZ0);
+}
+
+
+// is the transmit data register empty?
+static inline bool hal_uart_ready()
+{
+	return (HAL_UCSRA & (1 << HAL_UDRE)) != 0;
+}
+
+
+static inline void hal_uart_write(const uint8_t data)
+{
+	HAL_UCSRA |= 1 << HAL_TXC; // clear the transmit complete flag
+	HAL_UDR = data;
+}
+
+
+// has the last byte been shifted out completely?
+static inline bool hal_uart_tx_done()
+{
+	return (HAL_UCSRA & (1 << HAL_TXC)) != 0;
+}
+
+
+// did the byte in the receive register arrive with a framing error or after
+// an overrun? (check before hal_uart_read)
+static inline bool hal_uart_rx_error()
+{
+	return (HAL_UCSRA & ((1 << HAL_FE) | (1 << HAL_DOR))) != 0;
+}
+
+
+static inline uint8_t hal_uart_read()
+{
+	return HAL_UDR;
+}
+
+
+// enable or disable the USART_UDRE interrupt
+static inline void hal_uart_udre_irq(const bool enable)
+{
+	if (enable) {
+		HAL_UCSRB |= 1 << HAL_UDRIE;
+	} else {
+		HAL_UCSRB &= (uint8_t) ~(1 << HAL_UDRIE);
+	}
+}
+
+
+/* SPI */
+
+// be the SPI master at F_CPU / 2, most significant bit first, mode 0; MOSI,
+// SCK and SS must be outputs
+static inline void hal_spi_init()
+{
+	SPCR = (1 << SPE) | (1 << MSTR);
+	SPSR = 1 << SPI2X;
+}
+
+
+// shift out one byte (16 cycles)
+static inline void hal_spi_write(const uint8_t data)
+{
+	SPDR = data;
+	while ((SPSR & (1 << SPIF)) == 0) {}
+}
+
+
+/* EEPROM */
+
+// EE_RDY_vect may start a write between the steps of a read, which would
+// take over EEAR, so read with interrupts disabled, once the EEPROM is ready
+static inline uint8_t hal_eeprom_read_byte(const uint8_t *addr)
+{
+	const uint8_t sreg = SREG;
+	uint8_t data;
+
+	for (;;) {
+		eeprom_busy_wait();
+		cli();
+		if (eeprom_is_ready()) break;
+		SREG = sreg;
+	}
+	data = eeprom_read_byte(addr);
+	SREG = sreg;
+	return data;
+}
+
+
+static inline void hal_eeprom_read_block(void *dst, const void *src,
+                                         const size_t n)
+{
+	eeprom_read_block(dst, src, n);
+}
+
+
+// is the EEPROM done with the last write?
+static inline bool hal_eeprom_ready()
+{
+	return eeprom_is_ready();
+}
+
+
+// start writing one byte, which takes about 8.5 ms; the EEPROM must be ready
+// and interrupts must be disabled
+static inline void hal_eeprom_write_start(uint8_t *addr, const uint8_t data)
+{
+	EEAR = (uint16_t) addr;
+	EEDR = data;
+	EECR |= 1 << HAL_EEMWE; // EEWE has to follow within four cycles
+	EECR |= 1 << HAL_EEWE;
+}
+
+
+// enable or disable the EE_RDY interrupt, which fires while the EEPROM is
+// ready
+static inline void hal_eeprom_ready_irq(const bool enable)
+{
+	if (enable) {
+		EECR |= 1 << EERIE;
+	} else {
+		EECR &= (uint8_t) ~(1 << EERIE);
+	}
+}
+
+
+/* ANALOG COMPARATOR */
+
+// compare AIN1 (PD7) against the internal bandgap reference (1.23 V on the
+// ATmega8, 1.1 V on the others), and fire ANA_COMP_vect when AIN1 drops
+// below it
+static inline void hal_comparator_init()
+{
+	const uint8_t acsr = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0); // ACO rises
+
+	// changing ACSR may set the interrupt flag, so first let the bandgap
+	// settle with the interrupt off, and clear the flag (by writing a 1)
+	ACSR = acsr;
+	_delay_us(100);
+	ACSR = acsr | (1 << ACI);
+	ACSR = acsr | (1 << ACIE);
+}
+
+
+// is AIN1 below the bandgap reference?
+static inline bool hal_comparator_low()
+{
+	return (ACSR & (1 << ACO)) != 0;
+}
+
+
+/* TIMERS AND INTERRUPTS */
+
+// start Timer/Counter2 on the 32.768kHz crystal, overflowing twice a second
+static inline void hal_timer2_init()
+{
+	_delay_ms(1000); // wait for crystal to stabilize
+	ASSR |= 1 << AS2; // set async clocking
+	// prescaler 64 s.t. 0.5 seconds exactly overflows a 8 bit value
+	HAL_TCCR2 = (1 << CS22); // set the rest to 0
+	while ((ASSR & (1 << HAL_TCR2UB)) != 0) {} // wait TCCR2 to update
+	HAL_TIMSK2 |= 1 << TOIE2; // enable overflow interrupt
+}
+
+
+// the current value of the Timer2 counter
+static inline uint8_t hal_timer2_count()
+{
+	return TCNT2;
+}
+
+
+// fire TIMER2_COMP_vect when the counter steps from `at` to `at + 1`, and
+// every 256 counts after that
+static inline void hal_timer2_alarm(const uint8_t at)
+{
+	HAL_OCR2 = at;
+	while ((ASSR & (1 << HAL_OCR2UB)) != 0) {} // wait for OCR2 to update
+	HAL_TIFR2 = 1 << HAL_OCF2; // forget an old match
+	HAL_TIMSK2 |= 1 << HAL_OCIE2;
+}
+
+
+static inline void hal_timer2_alarm_off()
+{
+	HAL_TIMSK2 &= (uint8_t) ~(1 << HAL_OCIE2);
+}
+
+
+// run Timer0 at F_CPU / 8, with the overflow interrupt
+static inline void hal_timer0_start()
+{
+	TCNT0 = 0;
+	HAL_TCCR0 = 1 << CS01;
+	HAL_TIMSK0 |= 1 << TOIE0;
+}
+
+
+static inline void hal_timer0_stop()
+{
+	HAL_TIMSK0 &= (uint8_t) ~(1 << TOIE0);
+	HAL_TCCR0 = 0;
+}
+
+
+// from TIMER0_OVF_vect: overflow again `counts` after the last overflow
+static inline void hal_timer0_next(const uint8_t counts)
+{
+	TCNT0 = (uint8_t) (TCNT0 - counts);
+}
+
+
+// the pins in `mask` are about to show `value` with every dimmed light fully
+// on; the next Timer0 overflow writes the real bit plane, so leave them alone
+static inline void hal_timer0_preview(const enum hal_port port,
+                                      const uint8_t mask, const uint8_t value)
+{
+}
+
+
+// run Timer1 on the CPU clock, as a cycle counter
+static inline void hal_timer1_init()
+{
+	TCCR1A = 0;
+	TCCR1B = 1 << CS10; // no prescaler
+}
+
+
+// the Timer1 count; reading it takes two steps through the shared TEMP
+// register, which an interrupt handler must not use in between
+static inline uint16_t hal_timer1_count()
+{
+	const uint8_t sreg = SREG;
+	uint16_t count;
+
+	cli();
+	count = TCNT1;
+	SREG = sreg;
+	return count;
+}
+
+
+// 32 random bits from the jitter of the CPU clock against the crystal: the
+// lowest bit of a busy loop that waits for one Timer2 count, 32 times over
+// (about 60 ms, after hal_timer2_init)
+static inline uint32_t hal_entropy()
+{
+	uint32_t bits = 0;
+	uint8_t i, count, loops;
+
+	for (i = 0; i < 32; i++) {
+		count = TCNT2;
+		loops = 0;
+		while (TCNT2 == count) loops++;
+		bits = bits << 1 | (loops & 1);
+	}
+	return bits;
+}
+
+
+// fire INT0_vect when the CONTROL button goes down or up
+static inline void hal_int0_init()
+{
+	HAL_EICR = (HAL_EICR & (uint8_t) ~(1 << ISC01)) | (1 << ISC00); // any edge
+	HAL_EIMSK |= 1 << INT0; // enable interrupt on INT0
+}
+
+
+// an edge that comes in while INT0 is disabled fires when it is enabled again
+static inline void hal_int0_enable(const bool enable)
+{
+	if (enable) {
+		HAL_EIMSK |= 1 << INT0;
+	} else {
+		HAL_EIMSK &= (uint8_t) ~(1 << INT0);
+	}
+}
+
+
+static inline void hal_irq_enable()
+{
+	sei();
+}
+
+
+static inline void hal_irq_disable()
+{
+	cli();
+}
+
+
+static inline bool hal_irq_enabled()
+{
+	return (SREG & (1 << SREG_I)) != 0;
+}
+
+
+static inline void hal_sleep_enable()
+{
+	HAL_SMCR |= 1 << SE;
+}
+
+
+// choose what hal_sleep() switches off; in power-save mode only Timer2 and
+// a low level on INT0 can wake us up
+static inline void hal_sleep_mode(const enum hal_sleep_mode mode)
+{
+	HAL_SMCR &= (uint8_t) ~((1 << SM2) | (1 << SM1) | (1 << SM0));
+	if (mode == HAL_SLEEP_POWER_SAVE) {
+		HAL_SMCR |= (1 << SM1) | (1 << SM0);
+		// the Timer2 interrupt logic needs one TOSC1 cycle after a wake-up
+		// before it can wake us up again
+		HAL_TCCR2 = HAL_TCCR2;
+		while ((ASSR & (1 << HAL_TCR2UB)) != 0) {}
+	}
+}
+
+
+// enable interrupts and sleep until the next one
+static inline void hal_sleep()
+{
+	// the instruction after `sei` always runs before any interrupt, so an
+	// interrupt that comes in after the caller's last check still wakes us
+	sei();
+	sleep_cpu();
+}
+
+
+// _delay_ms needs a compile-time constant, so this cannot be a function
+#define hal_delay_ms(ms) _delay_ms(ms)
+
+
+/* WATCHDOG */
+
+// did the watchdog reset us? This clears the reset flags; the ATmega88 and up
+// keep the watchdog running (at its shortest timeout) until WDRF is cleared,
+// so call it first thing
+static inline bool hal_reset_by_watchdog()
+{
+#ifdef HAL_MEGA_X8
+	const bool watchdog = (MCUSR & (1 << WDRF)) != 0;
+
+	MCUSR = 0;
+	wdt_disable();
+#else /* HAL_MEGA_X8 */
+	const bool watchdog = (MCUCSR & (1 << WDRF)) != 0;
+
+	MCUCSR = 0;
+#endif /* HAL_MEGA_X8 */
+	return watchdog;
+}
+
+
+#ifdef ENABLE_WATCHDOG
+static inline void hal_wdt_enable()
+{
+	// enable watchdog Timer (watchdog of about 2 secs); the ATmega88 and up
+	// need a timed sequence for this, which wdt_enable knows
+	wdt_enable(WDTO_2S);
+}
+
+
+static inline void hal_wdt_reset()
+{
+	wdt_reset();
+}
+#endif /* ENABLE_WATCHDOG */
+
+#endif /* HAL_AVR_H_ */
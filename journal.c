@@ -0,0 +1,111 @@
+#include "journal.h"
+#include "crc16.h"
+#include "hal.h"
+#include "profile.h"
+#include "trace.h"
+#include <stddef.h>
+
+#if JOURNAL_RECORDS > 128
+#error "JOURNAL_RECORDS must be at most 128"
+#endif
+
+struct journal_record {
+	uint32_t timer;
+	uint16_t seq;
+	uint16_t state;
+	uint16_t crc;     // over the rest, written last
+};
+
+static struct journal_record EEMEM journal[JOURNAL_RECORDS];
+
+// the record that was written last, and its sequence number
+static uint8_t last = JOURNAL_RECORDS - 1;
+static uint16_t last_seq = 0;
+
+// the record that the EE_RDY interrupt is writing
+static struct journal_record pending;
+static volatile uint8_t pending_pos = sizeof(pending);
+
+
+static uint16_t record_crc(const struct journal_record *record)
+{
+	const uint8_t *bytes = (const uint8_t *) record;
+	uint16_t crc = 0xffff;
+	uint8_t i;
+
+	for (i = 0; i < offsetof(struct journal_record, crc); i++) {
+		crc = crc16_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+
+bool journal_init(uint32_t *timer, uint16_t *state)
+{
+	struct journal_record record;
+	bool found = false;
+	uint8_t i;
+
+	for (i = 0; i < JOURNAL_RECORDS; i++) {
+		hal_eeprom_read_block(&record, &journal[i], sizeof(record));
+		if (record.crc != record_crc(&record)) continue;
+		// sequence numbers wrap around, but all records are close together
+		if (found && (int16_t) (record.seq - last_seq) <= 0) continue;
+		found = true;
+		last = i;
+		last_seq = record.seq;
+		*timer = record.timer;
+		*state = record.state;
+	}
+	return found;
+}
+
+
+bool journal_write(uint32_t timer, uint16_t state)
+{
+	const bool irq = hal_irq_enabled();
+
+	// an interrupt handler must not start a write half way ours
+	hal_irq_disable();
+	if (journal_busy()) {
+		if (irq) hal_irq_enable();
+		return false;
+	}
+	last = (last + 1) % JOURNAL_RECORDS;
+	trace(TRACE_JOURNAL, last);
+	pending.seq = ++last_seq;
+	pending.timer = timer;
+	pending.state = state;
+	pending.crc = record_crc(&pending);
+	pending_pos = 0;
+	hal_eeprom_ready_irq(true);
+	if (irq) hal_irq_enable();
+	return true;
+}
+
+
+bool journal_busy()
+{
+	return pending_pos < sizeof(pending);
+}
+
+
+ISR(EE_RDY_vect)
+{
+	const uint16_t start = profile_start();
+	const uint8_t *src = (const uint8_t *) &pending;
+	uint8_t *dst = (uint8_t *) &journal[last];
+
+	// skip the bytes that are already right
+	while (pending_pos < sizeof(pending) &&
+	       hal_eeprom_read_byte(dst + pending_pos) == src[pending_pos]) {
+		pending_pos++;
+	}
+	if (pending_pos == sizeof(pending)) {
+		hal_eeprom_ready_irq(false);
+	} else {
+		hal_eeprom_write_start(dst + pending_pos, src[pending_pos]);
+		pending_pos++;
+	}
+	profile_end(PROFILE_EE_RDY, start);
+}
@@ -0,0 +1,38 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+/*
+ * Time journal in the EEPROM
+ *
+ * Instead of overwriting one backup over and over again, every backup goes
+ * into the next record of a ring of JOURNAL_RECORDS records. A record holds a
+ * sequence number, the time, 16 bits of state for the main loop and a CRC, so
+ * after a reset the newest intact record wins. Records are written one byte
+ * at a time from the EE_RDY interrupt (bytes that do not change are skipped),
+ * with the CRC last, so a reset half way a write leaves the previous record
+ * as the newest one.
+ *
+ * With 32 records and a backup every 10 minutes, every byte is written at
+ * most 4.5 times a day, which is good for 60 years of the 100,000 write
+ * cycles the EEPROM is specified for.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef JOURNAL_RECORDS
+#define JOURNAL_RECORDS 32
+#endif /* JOURNAL_RECORDS */
+
+// find the newest record, returns false if there is none
+bool journal_init(uint32_t *timer, uint16_t *state);
+
+// start writing `timer` and `state` to the next record, returns false (and
+// does not write anything) if the previous write is not done yet; this may
+// also be called from an interrupt handler
+bool journal_write(uint32_t timer, uint16_t state);
+
+// is a record being written?
+bool journal_busy();
+
+#endif /* JOURNAL_H_ */
@@ -0,0 +1,56 @@
+#ifndef LIGHTS_H_
+#define LIGHTS_H_
+
+/*
+ * Light states
+ *
+ * A light state is a bit mask with bit `LIGHT_x` set if light x is on. The
+ * functions below map a light state onto the port pins from pins.h. They are
+ * only meant to be called with a constant `port`, in which case they fold into
+ * a constant mask and a few bit tests, without any loops or tables.
+ */
+
+#include "hal.h"
+#include "pins.h"
+#include <stdint.h>
+
+#define LIGHTS_NONE ((uint16_t) 0)
+#define LIGHTS_ALL ((uint16_t) ((1u << LIGHT_COUNT) - 1))
+
+// the pins on `port` that drive a light
+static inline uint8_t lights_port_mask(const enum hal_port port)
+{
+#define LIGHT_MASK(name, light_port, bit) \
+	| (light_port == port ? 1 << (bit) : 0)
+	return (uint8_t) (0 LIGHT_PINS(LIGHT_MASK));
+#undef LIGHT_MASK
+}
+
+
+// the value of the light pins on `port` for light state `lights`
+static inline uint8_t lights_port_value(const enum hal_port port,
+                                        const uint16_t lights)
+{
+#define LIGHT_VALUE(name, light_port, bit) \
+	| (light_port == port && (lights & (1 << LIGHT_##name)) ? 1 << (bit) : 0)
+	return (uint8_t) (0 LIGHT_PINS(LIGHT_VALUE));
+#undef LIGHT_VALUE
+}
+
+
+// the light state that shows `figure` in binary, with the lowest bit on the
+// last light
+static inline uint16_t lights_binary(const uint32_t figure)
+{
+	uint16_t lights = LIGHTS_NONE;
+	uint8_t i;
+
+	for (i = 0; i < LIGHT_COUNT; i++) {
+		if ((figure & ((uint32_t) 1 << i)) != 0) {
+			lights |= 1 << (LIGHT_COUNT - (i + 1));
+		}
+	}
+	return lights;
+}
+
+#endif /* LIGHTS_H_ */
@@ -1,172 +1,113 @@
-#define F_CPU 1000000L
-#define BLOCK_BEGIN_M 45
-#define BLOCK_END_M 30
-#define BLOCK_ANNOUNCE_M 37
-#define LONG_PRESS_DURATION 1000 /* ms */
 // Location: Nijmegen, The Netherlands
-#define LOCATION_LONGITUDE 51.8126
-#define LOCATION_LATITUDE 5.8372
+#define LOCATION_LATITUDE 51.8126 /* degrees north */
+#define LOCATION_LONGITUDE 5.8372 /* degrees east */
+// Time zone: Europe/Amsterdam (POSIX TZ format, see tz.h)
+#define DEFAULT_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
+// Back up the time to the EEPROM journal every 10 minutes (see journal.h), or
+// every hour when the power-fail interrupt backs it up as well: that still
+// bounds what a reset or a supply that drops too fast for the interrupt costs.
+// It must divide a day (see ticks_to_sleep).
+#ifdef ENABLE_POWER_FAIL
+#define BACKUP_INTERVAL 3600 /* s */
+#else /* ENABLE_POWER_FAIL */
+#define BACKUP_INTERVAL 600 /* s */
+#endif /* ENABLE_POWER_FAIL */
+
+// Only send state frames when asked to, so that they do not collide with the
+// other nodes on a shared line (PROTO_CMD_PERIOD turns them on)
+#define DEFAULT_STATE_PERIOD 0 /* s */
 
 // Update the state twice per second
 #define UPDATES_PER_SECOND 2.0
 
-#include "nl_dst.h"
+#include "anim.h"
+#include "blink.h"
+#include "button.h"
+#include "chain.h"
+#include "clock.h"
+#include "dim.h"
+#include "event.h"
+#include "hal.h"
+#include "journal.h"
+#include "lights.h"
+#include "pins.h"
+#include "print.h"
+#include "profile.h"
+#include "proto.h"
 #include "random.h"
+#include "schedule.h"
+#include "sun.h"
+#include "trace.h"
+#include "tz.h"
 #include "uart.h"
-#include <avr/cpufunc.h>
-#include <avr/eeprom.h>
-#include <avr/interrupt.h>
-#include <avr/io.h>
-#include <avr/sleep.h>
 #include <stdbool.h>
-#include <stdio.h>
-#include <util/delay.h>
-#include <util/eu_dst.h>
 #include <time.h>
 
-#ifdef ENABLE_WATCHDOG
-#include <avr/wdt.h>
-#endif /* ENABLE_WATCHDOG */
-
-
-struct tm_hms {
-	int8_t tm_hour;
-	int8_t tm_min;
-	int8_t tm_sec;
-};
-
-
-struct Input {
-	volatile unsigned char *ddr_reg;
-	const unsigned char ddr_shl;
-	volatile unsigned char *pin_reg;
-	const unsigned char pin_shl;
-};
-
-
-struct Output {
-	volatile unsigned char *ddr_reg;
-	const unsigned char ddr_shl;
-	volatile unsigned char *port_reg;
-	const unsigned char port_shl;
-};
 
 // 2 ticks per seconds, if we already tick'd this second then HALFSECOND = true
-volatile bool HALFSECOND = false;
+// (follows the Timer2 events in the main loop)
+bool HALFSECOND = false;
 
-volatile enum {
-	UP, DOWN, DOWN_AND_HANDLED
-} CONTROL_BUTTON_STATE = UP;
-
-// inputs and outputs
-const struct Input CONTROL_BUTTON = {&DDRD, DDD2, &PIND, PIND2};
-const struct Input S_SWITCH = {&DDRD, DDD5, &PIND, PIND5};
-const struct Output CPUBUSY_LED = {&DDRD, DDD4, &PORTD, PD4};
-const struct Output LIGHTS[] = {
-	{&DDRB, PB0, &PORTB, PB0},
-	{&DDRB, PB1, &PORTB, PB1},
-	{&DDRB, PB2, &PORTB, PB2},
-	{&DDRB, PB3, &PORTB, PB3},
-	{&DDRB, PB4, &PORTB, PB4},
-	{&DDRB, PB5, &PORTB, PB5},
-	{&DDRC, PC0, &PORTC, PC0},
-	{&DDRC, PC1, &PORTC, PC1},
-	{&DDRC, PC2, &PORTC, PC2},
-	{&DDRC, PC3, &PORTC, PC3}
-};
-const size_t LIGHT_COUNT = sizeof(LIGHTS) / sizeof(LIGHTS[0]);
 volatile enum {K_OFF, K_ON, K_FLASHING} K_STATE = K_OFF;
+
+// UPTIME at which K_STATE changes next (see update_state)
+uint32_t K_CHANGE_AT = 0;
 volatile enum {
 	CONTROL_OFF,
 	CONTROL_HOUR, CONTROL_MINUTE, CONTROL_SECOND,
 	CONTROL_DAY, CONTROL_MONTH, CONTROL_YEAR
 } CONTROL_STATE = CONTROL_OFF;
-volatile uint16_t CONTROL_BUTTON_PRESSED_MS = 0;
 
-// EEPROM address of the backed up timestamp
-uint32_t EEMEM TIME_BACKUP = 0xffffffff;
+// seconds since reset
+uint32_t UPTIME = 0;
 
+// the light state that is currently shown
+uint16_t LIGHTS = LIGHTS_NONE;
 
-/* UTILITY FUNCTIONS */
+// the light state that switch_lights showed last, before blinking
+uint16_t SHOWN_LIGHTS = LIGHTS_NONE;
 
-static struct tm_hms tm_hms_new_hms(const uint8_t h, const uint8_t m, const uint8_t s)
-{
-	struct tm_hms ret;
-	ret.tm_hour = h;
-	ret.tm_min = m;
-	ret.tm_sec = s;
-	return ret;
-}
+// the supply is failing, so the lights are off (see ANA_COMP_vect)
+volatile bool POWER_FAILED = false;
 
+// the lights that fade in and out (see pulse_lights)
+uint16_t PULSE_LIGHTS = LIGHTS_NONE;
 
-static struct tm_hms tm_hms_new_hm(const uint8_t h, const uint8_t m)
-{
-	return tm_hms_new_hms(h, m, 0);
-}
+// lights forced on over the UART, for FORCE_SECONDS more seconds
+uint16_t FORCE_LIGHTS = LIGHTS_NONE;
+uint16_t FORCE_SECONDS = 0;
 
+// the BACKUP_INTERVAL (counted from the epoch) of the last backup
+uint32_t BACKED_UP = 0;
 
-static bool tm_hms_lt(const struct tm_hms x, const struct tm_hms y)
-{
-	if (x.tm_hour < y.tm_hour) return true;
-	if (x.tm_hour > y.tm_hour) return false;
-	if (x.tm_min < y.tm_min) return true;
-	if (x.tm_min > y.tm_min) return false;
-	if (x.tm_sec < y.tm_sec) return true;
-	return false;
-}
-
-
-static bool tm_hms_le(const struct tm_hms x, const struct tm_hms y)
-{
-	if (x.tm_hour < y.tm_hour) return true;
-	if (x.tm_hour > y.tm_hour) return false;
-	if (x.tm_min < y.tm_min) return true;
-	if (x.tm_min > y.tm_min) return false;
-	if (x.tm_sec <= y.tm_sec) return true;
-	return false;
-}
+// seconds between state frames (0: off), and since the last one
+uint16_t STATE_PERIOD = DEFAULT_STATE_PERIOD;
+uint16_t STATE_ELAPSED = 0;
 
+// number of Timer2 ticks that the main loop sleeps through (see ticks_to_sleep)
+volatile uint8_t SLEEP_TICKS = 0;
 
-static struct tm_hms tm_hms_from_tm(const struct tm *in)
-{
-	struct tm_hms ret;
-	ret.tm_hour = in->tm_hour;
-	ret.tm_min = in->tm_min;
-	ret.tm_sec = in->tm_sec;
-	return ret;
-}
+// the Timer2 count after which the next compare match fires, if one does
+// (see TIMER2_COMP_vect)
+uint8_t ALARM_AT;
+volatile bool ALARM_ON = false;
 
+// EEPROM address of the time zone rule
+char EEMEM TZ_RULE[TZ_RULE_MAX] = DEFAULT_TZ;
 
-static bool tm_hms_is_between(const struct tm_hms cur,
-                              const struct tm_hms start,
-                              const struct tm_hms end)
-{
-	if (tm_hms_lt(start, end)) {
-		// normal
-		return tm_hms_le(start, cur) && tm_hms_le(cur, end);
-	} else {
-		// end < start
-		return tm_hms_le(start, cur) || tm_hms_le(cur, end);
-	}
-}
-
-
-static bool flashing_is_on()
-{
-	return HALFSECOND;
-}
+// EEPROM address of our address in the binary protocol
+uint8_t EEMEM PROTO_ADDRESS = 1;
 
 
-static bool control_button_is_down()
-{
-	return (*CONTROL_BUTTON.pin_reg & (1 << CONTROL_BUTTON.pin_shl)) != 0;
-}
-
+/* UTILITY FUNCTIONS */
 
-static void printf_time(char *fmt, time_t timer)
+// print `label` (in flash) and the current time on a line of their own
+static void print_time_line(const char *label)
 {
-	if (timer == 0) time(&timer);
-	printf(fmt, ctime(&timer));
+	print_P(label);
+	print_time(clock_local());
+	print_P(PSTR("\r\n"));
 }
 
 
@@ -174,180 +115,105 @@ static void printf_time(char *fmt, time_t timer)
 
 static void cpubusy_on()
 {
-	*CPUBUSY_LED.port_reg |= (1 << CPUBUSY_LED.port_shl);
+	hal_io_write(CPUBUSY_LED_PORT, 1 << CPUBUSY_LED_BIT, 0xff);
 }
 
 
 static void cpubusy_off()
 {
-	*CPUBUSY_LED.port_reg &= ~(1 << CPUBUSY_LED.port_shl);
+	hal_io_write(CPUBUSY_LED_PORT, 1 << CPUBUSY_LED_BIT, 0x00);
 }
 
 
 /* LIGHT SWITCHING */
 
-static void switch_lights(const bool lights_on[LIGHT_COUNT])
-{
-	size_t i;
-	uint8_t maskb = 0, maskc = 0;
-	uint8_t portb = 0, portc = 0;
-	const struct Output *light;
-
-	// which bits are we allowed to touch?
-	for (i = 0; i < LIGHT_COUNT; i++) {
-		maskb |= (uint8_t) ((LIGHTS[i].port_reg == &PORTB) << LIGHTS[i].port_shl);
-		maskc |= (uint8_t) ((LIGHTS[i].port_reg == &PORTC) << LIGHTS[i].port_shl);
-	}
-
-	// build new PORT{B,C} values
-	for (i = 0; i < LIGHT_COUNT; i++) {
-		light = &LIGHTS[i];
-		if (light->port_reg == &PORTB) {
-			portb |= (uint8_t) (lights_on[i] << light->port_shl);
-		}
-		if (light->port_reg == &PORTC) {
-			portc |= (uint8_t) (lights_on[i] << light->port_shl);
-		}
-	}
-
-	// output values
-	PORTB = (uint8_t) (PORTB & ~maskb) | portb;
-	PORTC = (uint8_t) (PORTC & ~maskc) | portc;
-}
-
-
-/* LIGHT LOGIC */
-
-static bool get_light_down_value(const struct tm *cur_tm)
-{
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(21, 30);
-	const struct tm_hms end = tm_hms_new_hm(8, 00);
-	return tm_hms_is_between(cur, start, end);
-}
-
-
-static bool get_light_one_value(const struct tm *cur_tm)
+#ifdef LIGHTS_CHAIN
+// show `lights` on every indicator on the chain, but for the blinking lights
+// that are off right now; call with interrupts disabled
+static void write_chain(const uint16_t lights)
 {
-	// on during the first block
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(8, BLOCK_BEGIN_M);
-	const struct tm_hms end = tm_hms_new_hm(10, BLOCK_END_M);
-	const struct tm_hms a_start = tm_hms_new_hm(8, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end = tm_hms_new_hm(8, BLOCK_BEGIN_M);
+	uint16_t frame[LIGHTS_CHAIN];
+	uint8_t i;
 
-	if (tm_hms_is_between(cur, start, end)) {
-		return true;
-	} else if (tm_hms_is_between(cur, a_start, a_end)) {
-		return flashing_is_on();
-	}
-	return false;
+	for (i = 0; i < LIGHTS_CHAIN; i++) frame[i] = lights & ~blink_hidden();
+	chain_write(frame);
 }
+#endif /* LIGHTS_CHAIN */
 
 
-static bool get_light_two_value(const struct tm *cur_tm)
+// show the light state `lights` with brightness `levels` (NULL for full, see
+// dim.h), or show it on every indicator on the chain (which does not dim);
+// the blinking lights are switched off when their pattern says so
+static void switch_lights(const uint16_t lights, const uint8_t *levels)
 {
-	// on during the second block
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(10, BLOCK_BEGIN_M);
-	const struct tm_hms end = tm_hms_new_hm(12, BLOCK_END_M);
-	const struct tm_hms a_start = tm_hms_new_hm(10, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end = tm_hms_new_hm(10, BLOCK_BEGIN_M);
-
-	if (tm_hms_is_between(cur, start, end)) {
-		return true;
-	} else if (tm_hms_is_between(cur, a_start, a_end)) {
-		return flashing_is_on();
-	}
-	return false;
+	const bool irq = hal_irq_enabled();
+
+	if (lights != SHOWN_LIGHTS) trace(TRACE_LIGHTS, lights);
+
+	// the Timer2 compare interrupt shows the blinking too
+	hal_irq_disable();
+	SHOWN_LIGHTS = lights;
+#ifdef LIGHTS_CHAIN
+	(void) levels;
+	write_chain(lights);
+#else /* LIGHTS_CHAIN */
+	dim_hide(blink_hidden());
+	dim_show(lights, levels);
+#endif /* LIGHTS_CHAIN */
+	if (irq) hal_irq_enable();
 }
 
 
-static bool get_light_three_value(const struct tm *cur_tm)
+// from the Timer2 compare interrupt: the blinking lights changed
+static void show_blink()
 {
-	// on during the third block
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(13, BLOCK_BEGIN_M);
-	const struct tm_hms end = tm_hms_new_hm(15, BLOCK_END_M);
-	const struct tm_hms a_start = tm_hms_new_hm(13, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end = tm_hms_new_hm(13, BLOCK_BEGIN_M);
-
-	if (tm_hms_is_between(cur, start, end)) {
-		return true;
-	} else if (tm_hms_is_between(cur, a_start, a_end)) {
-		return flashing_is_on();
-	}
-	return false;
+#ifdef LIGHTS_CHAIN
+	write_chain(SHOWN_LIGHTS);
+#else /* LIGHTS_CHAIN */
+	dim_hide(blink_hidden());
+#endif /* LIGHTS_CHAIN */
 }
 
 
-static bool get_light_four_value(const struct tm *cur_tm)
+// let K fade in and out while it flashes; the chain cannot dim, so there it
+// blinks instead (see blink_lights)
+static void pulse_lights(const uint16_t k)
 {
-	// on during the fourth block
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(15, BLOCK_BEGIN_M);
-	const struct tm_hms end = tm_hms_new_hm(17, BLOCK_END_M);
-	const struct tm_hms a_start = tm_hms_new_hm(15, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end = tm_hms_new_hm(15, BLOCK_BEGIN_M);
-
-	if (tm_hms_is_between(cur, start, end)) {
-		return true;
-	} else if (tm_hms_is_between(cur, a_start, a_end)) {
-		return flashing_is_on();
+#ifndef LIGHTS_CHAIN
+	if (k == PULSE_LIGHTS) return;
+	PULSE_LIGHTS = k;
+	if (k != LIGHTS_NONE) {
+		anim_play(ANIM_PULSE, k, true);
+	} else if (anim_playing() == ANIM_PULSE) {
+		anim_stop();
 	}
-	return false;
+#endif /* LIGHTS_CHAIN */
 }
 
 
-static bool get_light_five_value(const struct tm *cur_tm)
-{
-	// opening times of the Refter
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(15, 0);
-	const struct tm_hms end = tm_hms_new_hm(17, 0);
-	return tm_hms_is_between(cur, start, end);
-}
-
+/* LIGHT LOGIC */
 
-static bool get_light_b_value(const struct tm *cur_tm)
+// draw the time of the next change of K_STATE
+static void k_schedule()
 {
-	// is it time for beer?
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms start = tm_hms_new_hm(16, 0);
-	const struct tm_hms end = tm_hms_new_hm(21, 0);
-	return tm_hms_is_between(cur, start, end);
+	// K_ON and K_OFF change once every 5 hours on average, K_FLASHING
+	// stops after 100 seconds
+	K_CHANGE_AT = UPTIME + random_geometric(K_STATE == K_FLASHING ?
+	                                        100 : 5*60*60);
 }
 
 
-static bool get_light_k_value(const struct tm *cur_tm)
+// K is on while it flashes, pulse_lights or blink_lights take care of that
+static bool get_light_k_value()
 {
-	return K_STATE == K_ON || (K_STATE == K_FLASHING && flashing_is_on());
+	return K_STATE == K_ON || K_STATE == K_FLASHING;
 }
 
 
-static bool get_light_s_value(const struct tm *_)
+static bool get_light_s_value()
 {
 	// on if we are in the southern canteen (controlled by switch)
-	return (*S_SWITCH.pin_reg & (1 << S_SWITCH.pin_shl)) != 0;
-}
-
-
-static bool get_light_up_value(const struct tm *cur_tm)
-{
-	const struct tm_hms cur = tm_hms_from_tm(cur_tm);
-	const struct tm_hms a_start1 = tm_hms_new_hm(8, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end1 = tm_hms_new_hm(8, BLOCK_BEGIN_M);
-	const struct tm_hms a_start2 = tm_hms_new_hm(10, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end2 = tm_hms_new_hm(10, BLOCK_BEGIN_M);
-	const struct tm_hms a_start3 = tm_hms_new_hm(13, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end3 = tm_hms_new_hm(13, BLOCK_BEGIN_M);
-	const struct tm_hms a_start4 = tm_hms_new_hm(15, BLOCK_ANNOUNCE_M);
-	const struct tm_hms a_end4 = tm_hms_new_hm(15, BLOCK_BEGIN_M);
-
-	return tm_hms_is_between(cur, a_start1, a_end1) ||
-	       tm_hms_is_between(cur, a_start2, a_end2) ||
-	       tm_hms_is_between(cur, a_start3, a_end3) ||
-	       tm_hms_is_between(cur, a_start4, a_end4);
+	return (hal_io_read(S_SWITCH_PORT) & (1 << S_SWITCH_BIT)) != 0;
 }
 
 
@@ -355,10 +221,7 @@ static bool get_light_up_value(const struct tm *cur_tm)
 
 static void control_button_shortpress()
 {
-	time_t current_time = time(NULL);
-	struct tm current_tm;
-
-	localtime_r(&current_time, &current_tm);
+	struct tm current_tm = *clock_local();
 
 	// update time figure
 	switch (CONTROL_STATE) {
@@ -395,8 +258,8 @@ static void control_button_shortpress()
 	}
 
 	// write the new system time
-	set_system_time(mktime(&current_tm));
-	printf_time("New time: %s\r\n", 0);
+	clock_set(mktime(&current_tm));
+	print_time_line(PSTR("New time: "));
 }
 
 
@@ -405,93 +268,325 @@ static void control_button_longpress()
 	// go to the next control state
 	switch (CONTROL_STATE) {
 		case CONTROL_OFF:
-			printf("Control mode on\r\n");
+			print_P(PSTR("Control mode on\r\n"));
 			CONTROL_STATE = CONTROL_HOUR;
-			printf("Control mode: hour\r\n");
+			print_P(PSTR("Control mode: hour\r\n"));
 			break;
 		case CONTROL_HOUR:
 			CONTROL_STATE = CONTROL_MINUTE;
-			printf("Control mode: minute\r\n");
+			print_P(PSTR("Control mode: minute\r\n"));
 			break;
 		case CONTROL_MINUTE:
 			CONTROL_STATE = CONTROL_SECOND;
-			printf("Control mode: second\r\n");
+			print_P(PSTR("Control mode: second\r\n"));
 			break;
 		case CONTROL_SECOND:
 			CONTROL_STATE = CONTROL_DAY;
-			printf("Control mode: day\r\n");
+			print_P(PSTR("Control mode: day\r\n"));
 			break;
 		case CONTROL_DAY:
 			CONTROL_STATE = CONTROL_MONTH;
-			printf("Control mode: month\r\n");
+			print_P(PSTR("Control mode: month\r\n"));
 			break;
 		case CONTROL_MONTH:
 			CONTROL_STATE = CONTROL_YEAR;
-			printf("Control mode: year\r\n");
+			print_P(PSTR("Control mode: year\r\n"));
 			break;
 		default:
 			CONTROL_STATE = CONTROL_OFF;
-			printf("Control mode off\r\n");
+			print_P(PSTR("Control mode off\r\n"));
 			break;
 	}
 }
 
-// this function assumes that interrupts are currently DISABLED
-static void backup_time(uint32_t timer)
+// the state that is backed up next to the time
+static uint16_t backup_state()
 {
-	printf("Backing up time... ");
-	eeprom_write_dword(&TIME_BACKUP, timer);
-	printf("ok\r\n");
+	return K_STATE | (uint16_t) CONTROL_STATE << 8;
 }
 
 
-// this function also assumes that interrupts are currently DISABLED
+// the journal writes the backup in the background, returns false when it
+// could not take it yet
+static bool backup_time(uint32_t timer)
+{
+	if (!journal_write(timer, backup_state())) {
+		print_P(PSTR("Backup skipped, EEPROM busy\r\n"));
+		return false;
+	}
+	return true;
+}
+
+
+// back up once the time is in another BACKUP_INTERVAL than at the last backup,
+// so that a second that the main loop missed does not skip it, and retry a
+// second later while the EEPROM is busy
 static void maybe_backup_time() {
-	uint32_t timer;
-	struct tm tm;
+	const uint32_t now = time(NULL);
+
+	if (HALFSECOND || now / BACKUP_INTERVAL == BACKED_UP) return;
+
+	if (backup_time(now)) BACKED_UP = now / BACKUP_INTERVAL;
+}
 
+// this function dumps the current time on every minute
+static void maybe_print_time() {
 	if (HALFSECOND) return;
 
-	time(&timer);
-	gmtime_r(&timer, &tm);
+	if (clock_local()->tm_sec == 0) {
+		print_time_line(PSTR("Current time: "));
+	}
+}
+
+// every PROFILE_INTERVAL minutes, print where the cycles went
+static void maybe_report_profile() {
+#ifdef ENABLE_PROFILE
+	const struct tm *tm = clock_local();
 
-	if (tm.tm_hour == 0 && tm.tm_min == 0 && tm.tm_sec == 0) {
-		backup_time(timer);
+	if (!HALFSECOND && tm->tm_sec == 0 && tm->tm_min % PROFILE_INTERVAL == 0) {
+		profile_report();
 	}
+#endif /* ENABLE_PROFILE */
 }
 
-// this function dumps the current time on every minute
-static void maybe_print_time() {
-	uint32_t timer;
-	struct tm tm;
 
-	if (HALFSECOND) return;
+/* BINARY PROTOCOL */
+
+#ifdef ENABLE_TRACE
+// send the trace, in frames with sequence number `seq`
+static void send_trace(const uint8_t seq, const bool watchdog)
+{
+	uint8_t payload[1 + PROTO_TRACE_RECORDS * 4];
+	struct trace_record record;
+	// the interrupt handlers go on while the frames are sent
+	const uint8_t count = trace_hold();
+	uint8_t i, len;
+
+	proto_put_u32(payload + PROTO_TRACE_HEAD_TIME, time(NULL) + UNIX_OFFSET);
+	proto_put_u16(payload + PROTO_TRACE_HEAD_NOW, trace_now());
+	payload[PROTO_TRACE_HEAD_COUNT] = count;
+	payload[PROTO_TRACE_HEAD_WATCHDOG] = watchdog;
+	proto_send(seq, PROTO_TRACE_HEAD, payload, PROTO_TRACE_HEAD_LEN);
+	for (i = 0; i < count; i += PROTO_TRACE_RECORDS) {
+		payload[0] = i;
+		for (len = 1; len < sizeof(payload) && i + len / 4 < count;
+		     len += 4) {
+			trace_get(i + len / 4, &record);
+			proto_put_u16(payload + len, record.what);
+			proto_put_u16(payload + len + 2, record.time);
+		}
+		proto_send(seq, PROTO_TRACE, payload, len);
+	}
+	trace_release();
+}
+#endif /* ENABLE_TRACE */
 
-	time(&timer);
-	gmtime_r(&timer, &tm);
-	if (tm.tm_sec == 0) {
-		printf_time("Current time: %s\r\n", timer);
+
+static void state_payload(uint8_t *payload)
+{
+	proto_put_u32(payload + PROTO_STATE_TIME, time(NULL) + UNIX_OFFSET);
+	proto_put_u16(payload + PROTO_STATE_LIGHTS, LIGHTS);
+	payload[PROTO_STATE_K] = K_STATE;
+	payload[PROTO_STATE_CONTROL] = CONTROL_STATE;
+	proto_put_u16(payload + PROTO_STATE_TX_DROPPED, UART_dropped());
+	proto_put_u16(payload + PROTO_STATE_RX_ERRORS,
+	              UART_rx_errors() + proto_errors());
+	proto_put_u32(payload + PROTO_STATE_UPTIME, UPTIME);
+}
+
+
+static void update_lights();
+
+static void handle_command(const struct proto_frame *cmd)
+{
+	uint8_t payload[PROTO_STATE_LEN];
+	uint8_t status = PROTO_OK;
+
+	switch (cmd->type) {
+		case PROTO_CMD_QUERY:
+			state_payload(payload);
+			proto_reply(cmd, PROTO_STATE, payload, PROTO_STATE_LEN);
+			return;
+		case PROTO_CMD_SET_TIME:
+			if (cmd->len != 4) {
+				status = PROTO_BAD_LENGTH;
+				break;
+			}
+			clock_set(proto_get_u32(cmd->payload) - UNIX_OFFSET);
+			print_time_line(PSTR("New time: "));
+			update_lights();
+			break;
+		case PROTO_CMD_FORCE:
+			if (cmd->len != 4) {
+				status = PROTO_BAD_LENGTH;
+				break;
+			}
+			FORCE_LIGHTS = proto_get_u16(cmd->payload) & LIGHTS_ALL;
+			FORCE_SECONDS = proto_get_u16(cmd->payload + 2);
+			update_lights();
+			break;
+		case PROTO_CMD_PERIOD:
+			if (cmd->len != 2) {
+				status = PROTO_BAD_LENGTH;
+				break;
+			}
+			STATE_PERIOD = proto_get_u16(cmd->payload);
+			STATE_ELAPSED = 0;
+			break;
+		case PROTO_CMD_SCHEDULE:
+			if (cmd->len < 1) {
+				status = PROTO_BAD_LENGTH;
+				break;
+			}
+			if (!schedule_write(cmd->payload[0], cmd->payload + 1,
+			                    cmd->len - 1)) {
+				status = PROTO_SCHEDULE_INVALID;
+			}
+			update_lights();
+			break;
+#ifdef ENABLE_TRACE
+		case PROTO_CMD_TRACE:
+			// it does not fit in the transmit buffer, so wait for the UART
+			if (cmd->addr == PROTO_BROADCAST) return;
+			UART_set_overflow(UART_BLOCK);
+			send_trace(cmd->seq, false);
+			UART_set_overflow(UART_DROP);
+			return;
+#endif /* ENABLE_TRACE */
+		default:
+			status = PROTO_BAD_COMMAND;
+			break;
 	}
+	proto_reply(cmd, PROTO_ACK, &status, 1);
+
+	// the lights may need other ticks now, recompute that on the next one
+	SLEEP_TICKS = 0;
+}
+
+
+// handle the commands that came in over the UART
+static void handle_commands()
+{
+	struct proto_frame cmd;
+
+	while (proto_poll(&cmd)) {
+		handle_command(&cmd);
+	}
+}
+
+
+// send a state frame every STATE_PERIOD seconds
+static void maybe_send_state(const uint32_t seconds)
+{
+	uint8_t payload[PROTO_STATE_LEN];
+
+	if (HALFSECOND || STATE_PERIOD == 0) return;
+	STATE_ELAPSED += seconds;
+	if (STATE_ELAPSED < STATE_PERIOD) return;
+	STATE_ELAPSED = 0;
+	state_payload(payload);
+	proto_send(proto_next_seq(), PROTO_STATE, payload, PROTO_STATE_LEN);
 }
 
 
 /* INTERRUPT HANDLERS */
 
+#if BLINK_TICK_COUNT % BUTTON_SAMPLE_COUNTS != 0 || \
+    BLINK_COUNTS % BUTTON_SAMPLE_COUNTS != 0
+#error "the wheel ticks of blink.h must be on the grid of the button samples"
+#endif
+
+// make sure that the Timer2 compare matches run, from the next multiple of
+// BUTTON_SAMPLE_COUNTS on; call with interrupts disabled
+static void alarm_start()
+{
+	if (ALARM_ON) return;
+	ALARM_ON = true;
+	ALARM_AT = hal_timer2_count() | (BUTTON_SAMPLE_COUNTS - 1);
+	hal_timer2_alarm(ALARM_AT);
+}
+
+
 ISR(INT0_vect)
 {
-	// the CONTROL button is down, reset the timer
-	if (CONTROL_BUTTON_STATE == UP) {
-		CONTROL_BUTTON_STATE = DOWN;
-	};
-	CONTROL_BUTTON_PRESSED_MS = 0;
+	const uint16_t start = profile_start();
+
+	// the CONTROL button went up or down
+	trace(TRACE_INT0, button_is_down());
+	button_edge();
+	alarm_start();
+	profile_end(PROFILE_INT0, start);
+}
+
+// on the grid of BUTTON_SAMPLE_COUNTS counts: every match while the button
+// is sampled, or else only the ticks of the blink wheel while a light blinks
+ISR(TIMER2_COMP_vect)
+{
+	const uint16_t start = profile_start();
+	const uint8_t count = ALARM_AT + 1;
+
+	if (button_sampling()) button_sample();
+	if (count % BLINK_COUNTS == BLINK_TICK_COUNT && blink_tick(count)) {
+		show_blink();
+	}
+
+	if (button_sampling()) {
+		ALARM_AT += BUTTON_SAMPLE_COUNTS;
+		hal_timer2_alarm(ALARM_AT);
+	} else if (blink_active()) {
+		ALARM_AT = count + ((BLINK_TICK_COUNT - 1 - count) &
+		                    (BLINK_COUNTS - 1));
+		hal_timer2_alarm(ALARM_AT);
+	} else {
+		ALARM_ON = false;
+		hal_timer2_alarm_off();
+	}
+	profile_end(PROFILE_TIMER2_COMP, start);
+}
+
+#ifdef ENABLE_POWER_FAIL
+ISR(ANA_COMP_vect)
+{
+	const uint16_t start = profile_start();
+
+	// the supply is about to drop: back up right away, while the capacitors
+	// still hold up; if a backup is being written, that one is recent enough
+	if (!POWER_FAILED) {
+		POWER_FAILED = true;
+		journal_write(time(NULL), backup_state());
+		event_post(EVENT_POWER_FAIL);
+	}
+	profile_end(PROFILE_ANA_COMP, start);
 }
+#endif /* ENABLE_POWER_FAIL */
 
 ISR(TIMER2_OVF_vect)
 {
-	if (HALFSECOND) {
-		system_tick();
+	static bool halfsecond = false;
+	const uint16_t start = profile_start();
+
+	trace_timer2_ovf();
+
+	// keep the system time in the interrupt, so it never misses a tick
+	if (halfsecond) system_tick();
+	blink_overflow(halfsecond);
+	halfsecond = !halfsecond;
+
+#ifdef ENABLE_POWER_SAVE
+	// INT0 does not see edges in power-save mode, so look at the button
+	if (button_is_down()) {
+		button_edge();
+		alarm_start();
 	}
-	HALFSECOND = !HALFSECOND;
+#endif /* ENABLE_POWER_SAVE */
+
+	// nothing to do for the main loop yet
+	if (SLEEP_TICKS != 0) {
+		SLEEP_TICKS--;
+	} else {
+		event_post(halfsecond ? EVENT_HALF_SECOND : EVENT_SECOND);
+	}
+	profile_end(PROFILE_TIMER2_OVF, start);
 }
 
 
@@ -501,157 +596,198 @@ int my_dst(const time_t *timer, int32_t *z) {
 
 /* MAINLOOP FUNCTIONS */
 
-int console_put(char c, FILE *file)
-{
-	UART_transmit(c);
-	return 0;
-}
-
 static void init()
 {
-	size_t i;
-	const struct Output *light;
-	uint8_t ddrb = 0, ddrc = 0, ddrd = 0;
 	uint32_t timer;
+	uint16_t state;
+	char tz_str[TZ_RULE_MAX];
+	struct tz_rule tz;
+	uint8_t proto_address, unused;
+	const bool watchdog = hal_reset_by_watchdog();
+
+	// run at F_CPU before the UART counts on it
+	hal_clock_init();
+
+	// keep the trace of what happened before the reset
+	trace_init(watchdog);
 
 	// set cpubusy led pin to output
-	*CPUBUSY_LED.ddr_reg |= (uint8_t) (1 << CPUBUSY_LED.ddr_shl);
-	_NOP();
+	hal_io_output(CPUBUSY_LED_PORT, 1 << CPUBUSY_LED_BIT);
 
-	// initialize the UART console
+	// initialize the UART
 	UART_init();
-	fdevopen(console_put, NULL);
-	printf("Starting liftlighter\r\n");
+	print_P(PSTR("Starting liftlighter\r\n"));
+	if (watchdog) print_P(PSTR("Reset by the watchdog\r\n"));
 
 	// set all light pins to output
-	for (i = 0; i < LIGHT_COUNT; i++) {
-		light = &LIGHTS[i];
-		if (light->ddr_reg == &DDRB) {
-			ddrb |= (uint8_t) (1 << light->ddr_shl);
-		} else if (light->ddr_reg == &DDRC) {
-			ddrc |= (uint8_t) (1 << light->ddr_shl);
-		} else if (light->ddr_reg == &DDRD) {
-			ddrd |= (uint8_t) (1 << light->ddr_shl);
-		}
-	}
-	DDRB |= ddrb;
-	DDRC |= ddrc;
-	DDRD |= ddrd;
-	_NOP(); // for synchronization
+#ifdef LIGHTS_CHAIN
+	chain_init();
+#else /* LIGHTS_CHAIN */
+	hal_io_output(HAL_PORTB, lights_port_mask(HAL_PORTB));
+	hal_io_output(HAL_PORTC, lights_port_mask(HAL_PORTC));
+	hal_io_output(HAL_PORTD, lights_port_mask(HAL_PORTD));
+#endif /* LIGHTS_CHAIN */
 
 	// turn on all lights to indicate startup
-	const bool lights_on[] = {true, true, true, true, true,
-		                      true, true, true, true, true};
-	switch_lights(lights_on);
+	switch_lights(LIGHTS_ALL, NULL);
 
 	// set CONTROL_BUTTON to input
-	*CONTROL_BUTTON.ddr_reg &= (uint8_t) ~(1 << CONTROL_BUTTON.ddr_shl);
-	_NOP();
+	hal_io_input(CONTROL_BUTTON_PORT, 1 << CONTROL_BUTTON_BIT);
 
 	// set S_SWITCH to input
-	*S_SWITCH.ddr_reg &= (uint8_t) ~(1 << S_SWITCH.ddr_shl);
-	_NOP();
+	hal_io_input(S_SWITCH_PORT, 1 << S_SWITCH_BIT);
+
+	// load the time zone
+	hal_eeprom_read_block(tz_str, TZ_RULE, sizeof(tz_str));
+	tz_str[sizeof(tz_str) - 1] = '\0';
+	if (!tz_parse(&tz, tz_str)) {
+		print_P(PSTR("Invalid time zone, using " DEFAULT_TZ "\r\n"));
+		tz_parse(&tz, DEFAULT_TZ);
+	}
+	tz_init(&tz);
 
 	// initialize the system time
-	timer = eeprom_read_dword(&TIME_BACKUP);
-	if (timer != 0xffffffff) {
-		// Restore backup time
-		printf("Restoring backup time... ");
-		set_system_time(timer);
-		printf("ok\r\n");
+	clock_init(tz.std_offset, tz_dst);
+	if (journal_init(&timer, &state)) {
+		// Restore backup time, and K and the control mode (update_state and
+		// update_lights_control reset them if they are invalid)
+		print_P(PSTR("Restoring backup time... "));
+		clock_set(timer);
+		K_STATE = state & 0xff;
+		CONTROL_STATE = state >> 8;
+		print_P(PSTR("ok\r\n"));
 	} else {
 #ifdef DEFAULT_TIME
-		printf("Setting timestamp to %lu... ", DEFAULT_TIME);
-		set_system_time(DEFAULT_TIME - UNIX_OFFSET);
-		printf("ok\r\n");
+		print_P(PSTR("Setting timestamp to "));
+		print_u32(DEFAULT_TIME, 0);
+		print_P(PSTR("... "));
+		clock_set(DEFAULT_TIME - UNIX_OFFSET);
+		print_P(PSTR("ok\r\n"));
 #else /* DEFAULT_TIME */
-		set_system_time(0);
+		clock_set(0);
 #endif /* DEFAULT_TIME */
 	}
-	set_zone(+1 * ONE_HOUR);
-	set_dst(nl_dst);
-	set_position(LOCATION_LONGITUDE, LOCATION_LATITUDE);
-	printf_time("Initialized time: %s\r\n", 0);
+	set_position(LOCATION_LATITUDE * ONE_DEGREE,
+	             LOCATION_LONGITUDE * ONE_DEGREE);
+	print_time_line(PSTR("Initialized time: "));
+	BACKED_UP = time(NULL) / BACKUP_INTERVAL;
+
+	// load the light schedule
+	if (!schedule_load()) {
+		print_P(PSTR("Invalid schedule, using the default\r\n"));
+	}
+
+	// listen to our own address in the binary protocol
+	hal_eeprom_read_block(&proto_address, &PROTO_ADDRESS, 1);
+	proto_init(proto_address);
+#ifdef ENABLE_TRACE
+	if (watchdog) send_trace(proto_next_seq(), true);
+#endif /* ENABLE_TRACE */
 
 	// initialize Timer/Counter2 to measure seconds
-	_delay_ms(1000); // wait for crystal to stabilize
-	ASSR |= 1 << AS2; // set async clocking
-	// prescaler 64 s.t. 0.5 seconds exactly overflows a 8 bit value
-	TCCR2 = (1 << CS22); // set the rest to 0
-	while ((ASSR & (1 << TCR2UB)) != 0) {} // wait TCCR2 to update
-	TIMSK |= 1 << TOIE2; // enable overflow interrupt
+	hal_timer2_init();
+
+	// start counting cycles, if we are profiling
+	profile_init();
+
+	// seed the random generator with the clock jitter and the time, and
+	// draw when K changes first
+	random_seed(hal_entropy() ^ (uint32_t) time(NULL));
+	k_schedule();
 
 	// setup the INT0 interrupt source
-	MCUCR |= (1 << ISC00) | (1 << ISC01); // on rising edge
-	GICR |= 1 << INT0; // enable interrupt on INT0
+	hal_int0_init();
 
 #ifdef ENABLE_WATCHDOG
 	// enable watchdog Timer (watchdog of about 2 secs)
-	WDTCR |= (1 << WDE) | (1 << WDP2) | (1 << WDP1) | (1 << WDP0);
-	_NOP();
-	printf("Watchdog enabled\r\n");
-	wdt_reset();
+	hal_wdt_enable();
+	print_P(PSTR("Watchdog enabled\r\n"));
+	hal_wdt_reset();
 #endif /* ENABLE_WATCHDOG */
 
+#ifdef ENABLE_POWER_FAIL
+	// watch the supply
+	hal_comparator_init();
+#endif /* ENABLE_POWER_FAIL */
+
+	// switch off the peripherals that this build does not use
+	unused = HAL_POWER_ADC | HAL_POWER_TWI;
+#ifndef ENABLE_POWER_FAIL
+	unused |= HAL_POWER_COMPARATOR;
+#endif /* ENABLE_POWER_FAIL */
+#ifdef LIGHTS_CHAIN
+	unused |= HAL_POWER_TIMER0;
+#else /* LIGHTS_CHAIN */
+	unused |= HAL_POWER_SPI;
+#endif /* LIGHTS_CHAIN */
+#ifndef ENABLE_PROFILE
+	unused |= HAL_POWER_TIMER1;
+#endif /* ENABLE_PROFILE */
+	hal_power_off(unused);
+
+	// from now on, never wait for the UART
+	UART_set_overflow(UART_DROP);
+
 	// enable global interrupt
-	sei();
+	hal_irq_enable();
+
+#ifndef LIGHTS_CHAIN
+	// test every light, on top of the lights that are on since the start
+	anim_play(ANIM_BOOT, LIGHTS_ALL, false);
+#endif /* LIGHTS_CHAIN */
 }
 
 
 static void update_state()
 {
-	if (HALFSECOND) {
+	if (HALFSECOND || UPTIME < K_CHANGE_AT) {
 		return;
 	}
 	switch (K_STATE) {
 		case K_ON:
 		case K_OFF:
-			// once every 5 hours (random), choose for `K` a new random state
-			if (randint(1, 5*60*60) <= 1) {
-				// go flashing once every 24 times (rare; once per 5 days)
-				if (randint(1, 24) <= 1) {
-					K_STATE = K_FLASHING;
-				} else {
-					K_STATE = !K_STATE;
-				}
+			// choose for `K` a new random state: go flashing once every
+			// 24 times (rare; once per 5 days)
+			if (random_one_in(24)) {
+				K_STATE = K_FLASHING;
+			} else {
+				K_STATE = !K_STATE;
 			}
 			break;
 		case K_FLASHING:
-			// stop flashing after (on average) 100 seconds
-			if (randint(1, 100) <= 1) {
-				K_STATE = K_OFF;
-			}
+			K_STATE = K_OFF;
 			break;
 		default:
 			// unreachable state, reset
 			K_STATE = K_OFF;
 	}
+	trace(TRACE_K, K_STATE);
+	k_schedule();
 }
 
 
-static void update_lights_normal(bool *lights_on, const struct tm *current_tm)
+// the lights from the schedule, K and S, and in `flashing` the ones of the
+// schedule that flash
+static uint16_t update_lights_normal(const struct tm *current_tm,
+                                     uint16_t *flashing)
 {
-	lights_on[0] = get_light_up_value(current_tm);
-	lights_on[1] = get_light_k_value(current_tm);
-	lights_on[2] = get_light_s_value(current_tm);
-	lights_on[3] = get_light_b_value(current_tm);
-	lights_on[4] = get_light_one_value(current_tm);
-	lights_on[5] = get_light_two_value(current_tm);
-	lights_on[6] = get_light_three_value(current_tm);
-	lights_on[7] = get_light_four_value(current_tm);
-	lights_on[8] = get_light_five_value(current_tm);
-	lights_on[9] = get_light_down_value(current_tm);
+	uint16_t lights;
+
+	schedule_lights(current_tm, &lights, flashing);
+	lights |= *flashing;
+	lights |= (uint16_t) get_light_k_value() << LIGHT_K;
+	lights |= (uint16_t) get_light_s_value() << LIGHT_S;
+	return lights;
 }
 
 
-static void update_lights_control(bool *lights_on, const struct tm *current_tm)
+static uint16_t update_lights_control(const struct tm *current_tm)
 {
 	uint32_t fig; // figure (hour/minute/etc.)
-	size_t i;
 
 	switch (CONTROL_STATE) {
 		case CONTROL_OFF:
-			return;
+			return LIGHTS_NONE;
 		case CONTROL_HOUR:
 			fig = current_tm->tm_hour;
 			break;
@@ -672,95 +808,295 @@ static void update_lights_control(bool *lights_on, const struct tm *current_tm)
 			break;
 		default:
 			CONTROL_STATE = CONTROL_OFF;
-			return;
+			return LIGHTS_NONE;
 	}
 
-	// show the figure in binary format (flashing with 0.5 Hz)
-	for (i = 0; i < LIGHT_COUNT; i++) {
-		const bool flashing_on = flashing_is_on();
-		const bool on = ((fig & ((uint32_t) 1 << i)) != 0);
-		lights_on[LIGHT_COUNT-(i+1)] = on && flashing_on;
-	}
+	// show the figure in binary format (blinking, see blink_lights)
+	return lights_binary(fig);
+}
+
 
+// give the schedule today's sunrise and sunset (only computed once a day)
+static void update_sun()
+{
+	uint16_t rise, set;
+
+	sun_times(time(NULL), clock_local(), &rise, &set);
+	schedule_set_sun(rise, set);
+}
+
+
+// blink the flashing lights of the schedule fast, K slowly (where it does
+// not pulse) and the figures of the control mode in a rhythm of their own
+// (see blink.h), and keep the wheel turning while anything blinks
+static void blink_lights(const uint16_t flashing, const uint16_t k,
+                         const uint16_t figure)
+{
+	const bool irq = hal_irq_enabled();
+
+	blink_set(BLINK_FAST, flashing);
+#ifdef LIGHTS_CHAIN
+	blink_set(BLINK_SLOW, k);
+#else /* LIGHTS_CHAIN */
+	(void) k;
+#endif /* LIGHTS_CHAIN */
+	blink_set(BLINK_FIGURE, figure);
+	hal_irq_disable();
+	if (blink_active()) alarm_start();
+	if (irq) hal_irq_enable();
 }
 
 
 static void update_lights()
 {
-	bool lights_on[] = {false, false, false, false, false,
-	                    false, false, false, false, false};
-	const time_t current_time = time(NULL);
-	struct tm current_tm;
+	const struct tm *current_tm = clock_local();
+	const uint8_t *levels = NULL;
+	uint16_t start, flashing = LIGHTS_NONE, k = LIGHTS_NONE;
+	uint16_t figure = LIGHTS_NONE;
+
+	if (CONTROL_STATE != CONTROL_OFF) {
+		LIGHTS = update_lights_control(current_tm);
+		figure = LIGHTS_ALL;
+	} else if (FORCE_SECONDS != 0) {
+		LIGHTS = FORCE_LIGHTS;
+	} else {
+		LIGHTS = update_lights_normal(current_tm, &flashing);
+		levels = schedule_levels(current_tm);
+		if (K_STATE == K_FLASHING) k = 1 << LIGHT_K;
+	}
+	start = profile_start();
+	blink_lights(flashing, k, figure);
+	switch_lights(LIGHTS, levels);
+	pulse_lights(k);
+	profile_end(PROFILE_SWITCH, start);
+}
+
+
+// count down the seconds that the lights stay forced
+static void update_force(const uint32_t seconds)
+{
+	if (HALFSECOND || FORCE_SECONDS == 0) return;
+	FORCE_SECONDS = (seconds < FORCE_SECONDS) ? FORCE_SECONDS - seconds : 0;
+}
 
-	localtime_r(&current_time, &current_tm);
 
+static void control_button_doublepress()
+{
+	// leave control mode right away
 	if (CONTROL_STATE != CONTROL_OFF) {
-		update_lights_control(lights_on, &current_tm);
+		CONTROL_STATE = CONTROL_OFF;
+		print_P(PSTR("Control mode off\r\n"));
+	}
+}
+
+
+// number of Timer2 ticks after this one that the main loop can sleep
+// through, because nothing changes before then
+static uint8_t ticks_to_sleep()
+{
+	const struct tm *tm = clock_local();
+	uint32_t seconds, next;
+
+	// the control mode shows the time as it goes (the blinking lights do
+	// not need the main loop, see blink.h)
+	if (CONTROL_STATE != CONTROL_OFF) return 0;
+
+	// print the time (and let the clock check for DST) on every minute
+	seconds = 60 - tm->tm_sec;
+
+	// the next change in the schedule
+	next = schedule_next_change(tm);
+	if (next < seconds) seconds = next;
+
+	// the next backup, or the next second while one is still due
+	if (time(NULL) / BACKUP_INTERVAL != BACKED_UP) {
+		next = 1;
 	} else {
-		update_lights_normal(lights_on, &current_tm);
+		next = BACKUP_INTERVAL - clock_utc_day_sec() % BACKUP_INTERVAL;
+	}
+	if (next < seconds) seconds = next;
+
+	// the end of forcing the lights, and the next state frame
+	if (FORCE_SECONDS != 0 && FORCE_SECONDS < seconds) seconds = FORCE_SECONDS;
+	if (STATE_PERIOD != 0 && STATE_PERIOD - STATE_ELAPSED < seconds) {
+		seconds = STATE_PERIOD - STATE_ELAPSED;
 	}
-	switch_lights(lights_on);
+
+	// the next change of K_STATE
+	if (K_CHANGE_AT - UPTIME < seconds) seconds = K_CHANGE_AT - UPTIME;
+
+	// from a whole second, the tick that is `seconds` away is number
+	// 2 * `seconds`; from half way a second it is one earlier
+	return HALFSECOND ? 2 * seconds - 2 : 2 * seconds - 1;
 }
 
 
-int main(void)
+#ifdef ENABLE_POWER_FAIL
+// shed the load: switch off all lights until the supply is back
+static void power_fail()
 {
-	init();
-	MCUCR |= 1 << SE; // enable sleep
+	print_P(PSTR("Power failing, lights off\r\n"));
+#ifndef LIGHTS_CHAIN
+	anim_stop();
+	PULSE_LIGHTS = LIGHTS_NONE;
+#endif /* LIGHTS_CHAIN */
+	LIGHTS = LIGHTS_NONE;
+	blink_lights(LIGHTS_NONE, LIGHTS_NONE, LIGHTS_NONE);
+	switch_lights(LIGHTS, NULL);
+}
 
-	do_sleep:
-	sleep_cpu();
 
-	// reset the watchdog
-	#ifdef ENABLE_WATCHDOG
-	wdt_reset();
-	#endif /* ENABLE_WATCHDOG */
+// has the supply come back?
+static bool power_restored()
+{
+	if (hal_comparator_low()) return false;
+	POWER_FAILED = false;
+	print_P(PSTR("Power restored\r\n"));
+	return true;
+}
+#endif /* ENABLE_POWER_FAIL */
 
-	cli(); // disable interrupts to prevent spurious INTO interrupts
-	cpubusy_on(); // cpubusy on
 
-	while (true) {
-		// turn on the cpubusy light
+// in power-save mode the UART, INT0 and Timer0 stop, so only use it when the
+// transmitter is done, nobody is setting the time and no light is dimmed; or
+// when the supply fails, as soon as the backup is written
+static enum hal_sleep_mode sleep_mode()
+{
+#ifdef ENABLE_POWER_FAIL
+	if (POWER_FAILED && !UART_tx_busy() && !journal_busy()) {
+		return HAL_SLEEP_POWER_SAVE;
+	}
+#endif /* ENABLE_POWER_FAIL */
+#ifdef ENABLE_POWER_SAVE
+	if (!UART_tx_busy() && CONTROL_STATE == CONTROL_OFF && !dim_active()) {
+		return HAL_SLEEP_POWER_SAVE;
+	}
+#endif /* ENABLE_POWER_SAVE */
+	return HAL_SLEEP_IDLE;
+}
 
-		if (CONTROL_BUTTON_STATE == DOWN && control_button_is_down()) {
-			if (CONTROL_BUTTON_PRESSED_MS >= LONG_PRESS_DURATION) {
-				// trigger long press
-				control_button_longpress();
-				// disable the button until the next 'down' event
-				CONTROL_BUTTON_STATE = DOWN_AND_HANDLED;
-			} else {
-				CONTROL_BUTTON_PRESSED_MS++;
-				_delay_ms(1);
-			}
-		} else if (CONTROL_BUTTON_STATE == DOWN) {
-			// button has *just* been lifted
+
+// the periodic work, on every Timer2 tick that we do not sleep through;
+// `seconds` have passed since the last one
+static void update_tick(const uint32_t seconds)
+{
+	uint16_t start;
+
+#ifdef ENABLE_POWER_FAIL
+	// while the supply fails, only the interrupt keeps the time
+	if (POWER_FAILED && !power_restored()) return;
+#endif /* ENABLE_POWER_FAIL */
+
+	// on each minute print the current time
+	start = profile_start();
+	maybe_print_time();
+	profile_end(PROFILE_PRINT_TIME, start);
+
+	// every BACKUP_INTERVAL, backup the time
+	start = profile_start();
+	maybe_backup_time();
+	profile_end(PROFILE_BACKUP, start);
+
+	// do update logic
+	start = profile_start();
+	update_state();
+	profile_end(PROFILE_STATE, start);
+	update_force(seconds);
+
+	// show new light state
+	start = profile_start();
+	update_sun();
+	update_lights();
+	profile_end(PROFILE_LIGHTS, start);
+
+	// report the new state
+	maybe_send_state(seconds);
+	maybe_report_profile();
+
+	// skip the ticks in which nothing happens, unless we are behind
+	hal_irq_disable();
+	if (!event_pending()) SLEEP_TICKS = ticks_to_sleep();
+	hal_irq_enable();
+}
+
+
+static void handle_event(const enum event event)
+{
+	const uint8_t control = CONTROL_STATE;
+	uint32_t seconds;
+	uint16_t start;
+
+	switch (event) {
+		case EVENT_SECOND:
+			HALFSECOND = false;
+			start = profile_start();
+			seconds = clock_update();
+			profile_end(PROFILE_CLOCK, start);
+			UPTIME += seconds;
+			update_tick(seconds);
+			break;
+		case EVENT_HALF_SECOND:
+			HALFSECOND = true;
+			update_tick(0);
+			break;
+		case EVENT_SHORT_PRESS:
 			control_button_shortpress();
-			CONTROL_BUTTON_STATE = DOWN_AND_HANDLED;
+			SLEEP_TICKS = 0;
 			break;
-		} else {
-			if (!control_button_is_down()) {
-				CONTROL_BUTTON_STATE = UP;
-			}
+		case EVENT_LONG_PRESS:
+			control_button_longpress();
+			SLEEP_TICKS = 0;
+			break;
+		case EVENT_DOUBLE_PRESS:
+			control_button_doublepress();
+			SLEEP_TICKS = 0;
+			break;
+		case EVENT_POWER_FAIL:
+#ifdef ENABLE_POWER_FAIL
+			power_fail();
+			SLEEP_TICKS = 0;
+#endif /* ENABLE_POWER_FAIL */
+			break;
+	}
+	if (CONTROL_STATE != control) trace(TRACE_CONTROL, CONTROL_STATE);
+}
 
-			// on each minute print the current time
-			maybe_print_time();
 
-			// if this is a day change, backup the time
-			maybe_backup_time();
+int main(void)
+{
+	enum event event;
+	uint16_t start;
 
-			// do update logic
-			update_state();
+	init();
+	hal_sleep_enable();
 
-			// show new light state
-			update_lights();
+	while (true) {
+		// sleep until the next interrupt, unless there is work left
+		hal_irq_disable();
+		if (!event_pending() && !UART_rx_pending()) {
+			hal_sleep_mode(sleep_mode());
+			hal_sleep();
+		}
+		hal_irq_enable();
 
-			break;
+		// reset the watchdog
+		#ifdef ENABLE_WATCHDOG
+		hal_wdt_reset();
+		#endif /* ENABLE_WATCHDOG */
+
+		// turn on the cpubusy light
+		cpubusy_on();
+
+		start = profile_start();
+		handle_commands();
+		profile_end(PROFILE_COMMANDS, start);
+		while (event_take(&event)) {
+			handle_event(event);
 		}
+
+		// turn off the cpubusy light
+		if (CONTROL_STATE == CONTROL_OFF) cpubusy_off();
 	}
-	// turn off the cpubusy light
-	if (CONTROL_STATE == CONTROL_OFF) cpubusy_off();
-	sei();
-	goto do_sleep;
 
 	return 0;
 }
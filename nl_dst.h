@@ -1,9 +0,0 @@
-#ifndef NL_DST_H_
-#define NL_DST_H_
-
-#include <inttypes.h>
-#include <time.h>
-
-int nl_dst(const time_t *timer, int32_t *_);
-
-#endif /* NL_DST_H_ */
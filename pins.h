@@ -0,0 +1,52 @@
+#ifndef PINS_H_
+#define PINS_H_
+
+/*
+ * Pin map
+ *
+ * LIGHT_PINS lists the lights as LIGHT(name, port, bit), in the order of their
+ * light numbers. Everything that depends on the wiring (the light numbers,
+ * the port masks in lights.h and the DDR setup in init) is derived from this
+ * list at compile time.
+ */
+
+#define LIGHT_PINS(LIGHT) \
+	LIGHT(UP,    HAL_PORTB, 0) \
+	LIGHT(K,     HAL_PORTB, 1) \
+	LIGHT(S,     HAL_PORTB, 2) \
+	LIGHT(B,     HAL_PORTB, 3) \
+	LIGHT(ONE,   HAL_PORTB, 4) \
+	LIGHT(TWO,   HAL_PORTB, 5) \
+	LIGHT(THREE, HAL_PORTC, 0) \
+	LIGHT(FOUR,  HAL_PORTC, 1) \
+	LIGHT(FIVE,  HAL_PORTC, 2) \
+	LIGHT(DOWN,  HAL_PORTC, 3)
+
+#define CONTROL_BUTTON_PORT HAL_PORTD
+#define CONTROL_BUTTON_BIT 2
+#define S_SWITCH_PORT HAL_PORTD
+#define S_SWITCH_BIT 5
+#define CPUBUSY_LED_PORT HAL_PORTD
+#define CPUBUSY_LED_BIT 4
+
+// with ENABLE_POWER_FAIL, the analog comparator watches the unregulated supply
+// on AIN1 (PD7) through a divider, like 68k over 10k for a 12 V supply, which
+// goes below the bandgap reference at about 9.6 V (8.6 V on the ATmega88 and
+// up)
+
+// the hardware SPI, and the latch of the shift registers (see chain.h); SS
+// (PB2) must be an output for the SPI to stay master, so it is the latch
+#define SPI_MOSI_BIT 3
+#define SPI_SCK_BIT 5
+#define CHAIN_LATCH_PORT HAL_PORTB
+#define CHAIN_LATCH_BIT 2
+
+// light numbers (bit positions in a light state)
+#define LIGHT_ENUM(name, port, bit) LIGHT_##name,
+enum light {
+	LIGHT_PINS(LIGHT_ENUM)
+	LIGHT_COUNT
+};
+#undef LIGHT_ENUM
+
+#endif /* PINS_H_ */
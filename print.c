@@ -0,0 +1,69 @@
+#include "print.h"
+
+#ifdef ENABLE_TEXT_LOG
+
+#include "hal.h"
+#include "uart.h"
+
+
+void print_P(const char *str)
+{
+	char c;
+
+	while ((c = pgm_read_byte(str++)) != '\0') {
+		UART_transmit(c);
+	}
+}
+
+
+void print(const char *str)
+{
+	while (*str != '\0') {
+		UART_transmit(*str++);
+	}
+}
+
+
+void print_u32(uint32_t value, uint8_t width)
+{
+	char digits[10];
+	uint8_t n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	while (width > n) {
+		UART_transmit('0');
+		width--;
+	}
+	while (n > 0) {
+		UART_transmit(digits[--n]);
+	}
+}
+
+
+// two digits, without a 32-bit division
+static void print_2(const uint8_t value)
+{
+	UART_transmit('0' + value / 10);
+	UART_transmit('0' + value % 10);
+}
+
+
+void print_time(const struct tm *tm)
+{
+	print_u32(tm->tm_year + 1900, 4);
+	UART_transmit('-');
+	print_2(tm->tm_mon + 1);
+	UART_transmit('-');
+	print_2(tm->tm_mday);
+	UART_transmit('T');
+	print_2(tm->tm_hour);
+	UART_transmit(':');
+	print_2(tm->tm_min);
+	UART_transmit(':');
+	print_2(tm->tm_sec);
+}
+
+#endif /* ENABLE_TEXT_LOG */
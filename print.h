@@ -0,0 +1,48 @@
+#ifndef PRINT_H_
+#define PRINT_H_
+
+/*
+ * Console output without stdio (build with -DENABLE_TEXT_LOG)
+ *
+ * Writes strings and numbers straight into the UART transmit buffer, so that
+ * neither avr-libc's vfprintf nor its time formatting end up in flash. Fixed
+ * strings should stay in flash: print them with print_P(PSTR("...")).
+ *
+ * The text log shares the UART with the binary protocol (see proto.h), and
+ * would collide with the replies of other nodes on a shared line, so without
+ * ENABLE_TEXT_LOG all of this compiles to nothing. The profile report is
+ * text, so ENABLE_PROFILE turns it on.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(ENABLE_PROFILE) && !defined(ENABLE_TEXT_LOG)
+#define ENABLE_TEXT_LOG
+#endif
+
+#ifdef ENABLE_TEXT_LOG
+
+// a string in flash
+void print_P(const char *str);
+
+// a string in RAM
+void print(const char *str);
+
+// `value` in decimal, padded with zeros to at least `width` digits
+void print_u32(uint32_t value, uint8_t width);
+
+// `tm` in ISO 8601, like 2017-03-16T09:00:00
+void print_time(const struct tm *tm);
+
+#else /* ENABLE_TEXT_LOG */
+
+// macros, so that the strings do not even end up in flash
+#define print_P(str) ((void) 0)
+#define print(str) ((void) 0)
+#define print_u32(value, width) ((void) 0)
+#define print_time(tm) ((void) 0)
+
+#endif /* ENABLE_TEXT_LOG */
+
+#endif /* PRINT_H_ */
@@ -0,0 +1,91 @@
+#include "profile.h"
+
+#ifdef ENABLE_PROFILE
+
+#include "print.h"
+#include "uart.h"
+#include <string.h>
+
+struct profile_stats {
+	uint16_t runs;
+	uint16_t min, max;
+	uint32_t total;
+	uint16_t histogram[PROFILE_BUCKETS];
+};
+
+static const char PHASE_NAMES[PROFILE_PHASES][12] PROGMEM = {
+	"clock", "print_time", "backup", "state", "lights", "switch",
+	"commands", "timer2_ovf", "timer2_comp", "int0", "timer0_ovf",
+	"usart_rxc", "usart_udre", "ee_rdy", "ana_comp"
+};
+
+// written by the main loop and the interrupt handlers, but every phase only
+// by one of them
+static struct profile_stats stats[PROFILE_PHASES];
+
+
+void profile_init(void)
+{
+	memset(stats, 0, sizeof(stats));
+	hal_timer1_init();
+}
+
+
+void profile_end(enum profile_phase phase, uint16_t start)
+{
+	struct profile_stats *s = &stats[phase];
+	const uint16_t cycles = hal_timer1_count() - start;
+	uint16_t c = cycles;
+	uint8_t bucket = 0;
+
+	while (c >= 4 && bucket < PROFILE_BUCKETS - 1) {
+		c >>= 2;
+		bucket++;
+	}
+	if (s->runs == 0 || cycles < s->min) s->min = cycles;
+	if (cycles > s->max) s->max = cycles;
+	if (s->runs != UINT16_MAX) {
+		s->runs++;
+		s->total += cycles;
+		s->histogram[bucket]++;
+	}
+}
+
+
+void profile_report(void)
+{
+	struct profile_stats s;
+	uint8_t i, j;
+
+	// this is far more than the transmit buffer holds
+	UART_set_overflow(UART_BLOCK);
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		// the interrupt handlers may update their phase while we copy it
+		hal_irq_disable();
+		s = stats[i];
+		memset(&stats[i], 0, sizeof(stats[i]));
+		hal_irq_enable();
+
+		print_P(PSTR("Profile "));
+		print_P(PHASE_NAMES[i]);
+		print_P(PSTR(": runs="));
+		print_u32(s.runs, 0);
+		if (s.runs != 0) {
+			print_P(PSTR(" min="));
+			print_u32(s.min, 0);
+			print_P(PSTR(" mean="));
+			print_u32(s.total / s.runs, 0);
+			print_P(PSTR(" max="));
+			print_u32(s.max, 0);
+			print_P(PSTR(" histogram="));
+			for (j = 0; j < PROFILE_BUCKETS; j++) {
+				if (j != 0) UART_transmit(',');
+				print_u32(s.histogram[j], 0);
+			}
+		}
+		print_P(PSTR("\r\n"));
+	}
+	UART_set_overflow(UART_DROP);
+}
+
+#endif /* ENABLE_PROFILE */
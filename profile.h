@@ -0,0 +1,78 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+/*
+ * Cycle-count profiling (build with -DENABLE_PROFILE)
+ *
+ * Timer1 counts CPU cycles, and every phase of the main loop and every
+ * interrupt handler is timed with it:
+ *
+ *     const uint16_t start = profile_start();
+ *     update_state();
+ *     profile_end(PROFILE_STATE, start);
+ *
+ * Per phase we keep the number of runs, the minimum, mean and maximum, and a
+ * histogram with buckets of powers of 4 cycles (< 4, < 16, ..., >= 16384).
+ * profile_report prints them to the UART and starts over. A phase that runs
+ * longer than 65535 cycles wraps around, and a phase includes the time spent
+ * in the interrupts that fire while it runs. The timing itself adds a few
+ * dozen cycles to every phase, which shows most in TIMER0_OVF and the UART.
+ *
+ * Without ENABLE_PROFILE all of this compiles to nothing.
+ */
+
+#include <stdint.h>
+
+// print a report every PROFILE_INTERVAL minutes
+#define PROFILE_INTERVAL 10 /* min */
+
+#define PROFILE_BUCKETS 8
+
+enum profile_phase {
+	PROFILE_CLOCK,       // clock_update
+	PROFILE_PRINT_TIME,  // maybe_print_time
+	PROFILE_BACKUP,      // maybe_backup_time
+	PROFILE_STATE,       // update_state
+	PROFILE_LIGHTS,      // update_lights, including switch_lights
+	PROFILE_SWITCH,      // switch_lights
+	PROFILE_COMMANDS,    // handle_commands
+	PROFILE_TIMER2_OVF,  // interrupt handlers
+	PROFILE_TIMER2_COMP,
+	PROFILE_INT0,
+	PROFILE_TIMER0_OVF,  // dim.c
+	PROFILE_USART_RXC,   // uart.c
+	PROFILE_USART_UDRE,
+	PROFILE_EE_RDY,      // journal.c
+	PROFILE_ANA_COMP,
+	PROFILE_PHASES
+};
+
+#ifdef ENABLE_PROFILE
+
+#include "hal.h"
+
+// start Timer1
+void profile_init(void);
+
+// the cycle count at the start of a phase
+static inline uint16_t profile_start(void)
+{
+	return hal_timer1_count();
+}
+
+// account the cycles since `start` to `phase`
+void profile_end(enum profile_phase phase, uint16_t start);
+
+// print the statistics of all phases, and clear them
+void profile_report(void);
+
+#else /* ENABLE_PROFILE */
+
+static inline void profile_init(void) {}
+static inline uint16_t profile_start(void) { return 0; }
+static inline void profile_end(enum profile_phase phase, uint16_t start) {}
+static inline void profile_report(void) {}
+
+#endif /* ENABLE_PROFILE */
+
+#endif /* PROFILE_H_ */
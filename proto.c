@@ -0,0 +1,192 @@
+#include "proto.h"
+#include "uart.h"
+#include <string.h>
+
+static uint8_t own_addr = 1;
+static uint8_t tx_seq = 0;
+static uint16_t rx_errors = 0;
+
+// receive state: how many bytes of the current frame we have seen
+static enum {
+	RX_SYNC, RX_HEADER, RX_PAYLOAD, RX_CRC
+} rx_state = RX_SYNC;
+static struct proto_frame rx_frame;
+static uint8_t rx_pos;
+static uint16_t rx_crc, rx_crc_received;
+
+// the bytes of a broken frame that still have to go through the parser again
+#define RX_REPLAY_SIZE (4 + PROTO_MAX_PAYLOAD + 2)
+static uint8_t rx_replay[RX_REPLAY_SIZE];
+static uint8_t rx_replay_pos, rx_replay_len;
+
+
+void proto_init(uint8_t addr)
+{
+	own_addr = addr;
+}
+
+
+// the byte at position `i` after the sync byte of the frame in `rx_frame`
+static uint8_t rx_frame_byte(const uint8_t i)
+{
+	if (i == 0) return rx_frame.addr;
+	if (i == 1) return rx_frame.seq;
+	if (i == 2) return rx_frame.type;
+	if (i == 3) return rx_frame.len;
+	if (i < 4 + rx_frame.len) return rx_frame.payload[i - 4];
+	return (i == 4 + rx_frame.len) ? rx_crc_received & 0xff :
+	                                 rx_crc_received >> 8;
+}
+
+
+// drop a broken frame of which `count` bytes after the sync byte came in
+//
+// The 0x7e that started it may have been noise, and then a real frame starts
+// somewhere in those bytes. So they go through the parser again, starting at
+// the next 0x7e, before any new byte. A frame is at most RX_REPLAY_SIZE bytes
+// after its sync byte, and it started after the sync byte of any earlier
+// replay, so what is left to replay always fits.
+static void rx_resync(const uint8_t count)
+{
+	uint8_t i = 0, n, left, j;
+
+	rx_errors++;
+	rx_state = RX_SYNC;
+	while (i < count && rx_frame_byte(i) != PROTO_SYNC) i++;
+	n = count - i;
+	left = rx_replay_len - rx_replay_pos;
+	memmove(rx_replay + n, rx_replay + rx_replay_pos, left);
+	for (j = 0; j < n; j++) {
+		rx_replay[j] = rx_frame_byte(i + j);
+	}
+	rx_replay_pos = 0;
+	rx_replay_len = n + left;
+}
+
+
+// the next byte to parse: a replayed one, or else one from the UART
+static bool rx_next(uint8_t *c)
+{
+	if (rx_replay_pos < rx_replay_len) {
+		*c = rx_replay[rx_replay_pos++];
+		return true;
+	}
+	return UART_receive(c);
+}
+
+
+// handle one received byte, returns true when `rx_frame` is complete
+static bool rx_byte(const uint8_t c)
+{
+	uint8_t *header = &rx_frame.addr;
+
+	switch (rx_state) {
+		case RX_SYNC:
+			if (c == PROTO_SYNC) {
+				rx_state = RX_HEADER;
+				rx_pos = 0;
+				rx_crc = 0xffff;
+			}
+			return false;
+		case RX_HEADER:
+			// addr, seq, type and len
+			header = (rx_pos == 0) ? &rx_frame.addr :
+			         (rx_pos == 1) ? &rx_frame.seq :
+			         (rx_pos == 2) ? &rx_frame.type : &rx_frame.len;
+			*header = c;
+			rx_crc = crc16_update(rx_crc, c);
+			if (++rx_pos < 4) return false;
+			if (rx_frame.len > PROTO_MAX_PAYLOAD) {
+				rx_resync(4);
+				return false;
+			}
+			rx_pos = 0;
+			rx_state = (rx_frame.len > 0) ? RX_PAYLOAD : RX_CRC;
+			return false;
+		case RX_PAYLOAD:
+			rx_frame.payload[rx_pos] = c;
+			rx_crc = crc16_update(rx_crc, c);
+			if (++rx_pos < rx_frame.len) return false;
+			rx_pos = 0;
+			rx_state = RX_CRC;
+			return false;
+		case RX_CRC:
+			if (rx_pos++ == 0) {
+				rx_crc_received = c;
+				return false;
+			}
+			rx_crc_received |= (uint16_t) c << 8;
+			rx_state = RX_SYNC;
+			if (rx_crc_received != rx_crc) {
+				rx_resync(4 + rx_frame.len + 2);
+				return false;
+			}
+			return true;
+		default:
+			rx_state = RX_SYNC;
+			return false;
+	}
+}
+
+
+bool proto_poll(struct proto_frame *cmd)
+{
+	uint8_t c;
+
+	while (rx_next(&c)) {
+		if (!rx_byte(c)) continue;
+		// ignore replies and frames for other indicators
+		if ((rx_frame.type & 0x80) != 0) continue;
+		if (rx_frame.addr != own_addr && rx_frame.addr != PROTO_BROADCAST) {
+			continue;
+		}
+		*cmd = rx_frame;
+		return true;
+	}
+	return false;
+}
+
+
+static void send_byte(uint16_t *crc, const uint8_t c)
+{
+	*crc = crc16_update(*crc, c);
+	UART_transmit(c);
+}
+
+
+void proto_send(uint8_t seq, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+	uint16_t crc = 0xffff;
+	uint8_t i;
+
+	UART_transmit(PROTO_SYNC);
+	send_byte(&crc, own_addr);
+	send_byte(&crc, seq);
+	send_byte(&crc, type);
+	send_byte(&crc, len);
+	for (i = 0; i < len; i++) {
+		send_byte(&crc, payload[i]);
+	}
+	UART_transmit(crc & 0xff);
+	UART_transmit(crc >> 8);
+}
+
+
+void proto_reply(const struct proto_frame *cmd, uint8_t type,
+                 const uint8_t *payload, uint8_t len)
+{
+	if (cmd->addr == PROTO_BROADCAST) return;
+	proto_send(cmd->seq, type, payload, len);
+}
+
+
+uint8_t proto_next_seq()
+{
+	return tx_seq++;
+}
+
+
+uint16_t proto_errors()
+{
+	return rx_errors;
+}
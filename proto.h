@@ -0,0 +1,118 @@
+#ifndef PROTO_H_
+#define PROTO_H_
+
+/*
+ * Binary telemetry and command protocol
+ *
+ * Every frame looks like this (multi-byte values are little endian):
+ *
+ *     0x7e | addr | seq | type | len | payload[len] | crc16
+ *
+ * `addr` is the address of the indicator that sends or should handle the
+ * frame (PROTO_BROADCAST addresses all of them, and they do not reply).
+ * Replies carry the `seq` of the command they answer, other frames carry a
+ * counter. The CRC is CRC-16/CCITT-FALSE over `addr` up to the payload.
+ * There is no byte stuffing: when the length or the CRC is wrong, the receiver
+ * hunts for the next 0x7e in the bytes it took for that frame, and then after
+ * it, until it finds one with a valid CRC.
+ */
+
+#include "crc16.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROTO_SYNC 0x7e
+#define PROTO_BROADCAST 0xff
+#define PROTO_MAX_PAYLOAD 16
+
+// frame types, commands have the high bit cleared
+enum proto_type {
+	PROTO_CMD_QUERY = 0x01,      // no payload, replied with PROTO_STATE
+	PROTO_CMD_SET_TIME = 0x02,   // u32 unix time
+	PROTO_CMD_FORCE = 0x03,      // u16 lights, u16 seconds (0: stop forcing)
+	PROTO_CMD_PERIOD = 0x04,     // u16 seconds between state frames (0: off)
+	PROTO_CMD_SCHEDULE = 0x05,   // u8 offset, bytes to write to the schedule
+	PROTO_CMD_TRACE = 0x06,      // no payload, replied with the trace
+	PROTO_STATE = 0x80,          // see PROTO_STATE_* below
+	PROTO_ACK = 0x81,            // u8 status
+	PROTO_TRACE_HEAD = 0x82,     // see PROTO_TRACE_HEAD_* below
+	PROTO_TRACE = 0x83,          // u8 index, up to PROTO_TRACE_RECORDS records
+};
+
+// PROTO_SCHEDULE_INVALID answers a PROTO_CMD_SCHEDULE after which the
+// schedule in the EEPROM is not (yet) valid, see schedule.h
+enum proto_status {
+	PROTO_OK, PROTO_BAD_COMMAND, PROTO_BAD_LENGTH, PROTO_SCHEDULE_INVALID
+};
+
+// offsets in the PROTO_STATE payload
+#define PROTO_STATE_TIME 0        // u32 unix time
+#define PROTO_STATE_LIGHTS 4      // u16 light state
+#define PROTO_STATE_K 6           // u8 K_STATE
+#define PROTO_STATE_CONTROL 7     // u8 CONTROL_STATE
+#define PROTO_STATE_TX_DROPPED 8  // u16 UART bytes dropped on transmit
+#define PROTO_STATE_RX_ERRORS 10  // u16 bad bytes or frames received
+#define PROTO_STATE_UPTIME 12     // u32 seconds since reset
+#define PROTO_STATE_LEN 16
+
+// the trace (see trace.h) is sent as a PROTO_TRACE_HEAD frame, followed by
+// PROTO_TRACE frames with the records from the oldest one on (u16 event and
+// data, u16 time); without ENABLE_TRACE the command is a PROTO_BAD_COMMAND
+#define PROTO_TRACE_HEAD_TIME 0      // u32 unix time
+#define PROTO_TRACE_HEAD_NOW 4       // u16 trace time at that moment
+#define PROTO_TRACE_HEAD_COUNT 6     // u8 number of records
+#define PROTO_TRACE_HEAD_WATCHDOG 7  // u8 1 if sent after a watchdog reset
+#define PROTO_TRACE_HEAD_LEN 8
+#define PROTO_TRACE_RECORDS 3
+
+struct proto_frame {
+	uint8_t addr;
+	uint8_t seq;
+	uint8_t type;
+	uint8_t len;
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+};
+
+static inline uint16_t proto_get_u16(const uint8_t *buf)
+{
+	return buf[0] | (uint16_t) buf[1] << 8;
+}
+
+static inline uint32_t proto_get_u32(const uint8_t *buf)
+{
+	return proto_get_u16(buf) | (uint32_t) proto_get_u16(buf + 2) << 16;
+}
+
+static inline void proto_put_u16(uint8_t *buf, const uint16_t value)
+{
+	buf[0] = value & 0xff;
+	buf[1] = value >> 8;
+}
+
+static inline void proto_put_u32(uint8_t *buf, const uint32_t value)
+{
+	proto_put_u16(buf, value & 0xffff);
+	proto_put_u16(buf + 2, value >> 16);
+}
+
+// set our own address
+void proto_init(uint8_t addr);
+
+// feed the received bytes to the parser, returns true when `cmd` is a command
+// for us (that still has to be handled)
+bool proto_poll(struct proto_frame *cmd);
+
+// send a frame with our address
+void proto_send(uint8_t seq, uint8_t type, const uint8_t *payload, uint8_t len);
+
+// send a reply to `cmd`, unless it was a broadcast
+void proto_reply(const struct proto_frame *cmd, uint8_t type,
+                 const uint8_t *payload, uint8_t len);
+
+// counter for unsolicited frames
+uint8_t proto_next_seq();
+
+// number of frames that were thrown away because of a bad CRC or length
+uint16_t proto_errors();
+
+#endif /* PROTO_H_ */
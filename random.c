@@ -1,16 +1,82 @@
 #include "random.h"
-#include <stdlib.h>
+#include "hal.h"
 
-int randint(const int min, const int max)
+static uint32_t state = 2463534242UL;
+
+
+void random_seed(uint32_t seed)
+{
+	// xorshift gets stuck on 0
+	state = (seed != 0) ? seed : 2463534242UL;
+}
+
+
+uint32_t random_u32(void)
+{
+	// xorshift32 (Marsaglia, 2003)
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+uint16_t random_below(uint16_t n)
+{
+	// scale the top 16 bits instead of dividing
+	return ((random_u32() >> 16) * n) >> 16;
+}
+
+
+bool random_one_in(uint16_t n)
+{
+	return random_below(n) == 0;
+}
+
+
+// ln(1 + i/16) for i = 0 to 16, as 16.16 fixed point
+#define LN2 45426
+static const uint16_t LN_TABLE[17] PROGMEM = {
+	0, 3973, 7719, 11262, 14624, 17821, 20870, 23783, 26573, 29248, 31818,
+	34292, 36675, 38975, 41196, 43345, 45426
+};
+
+
+// -ln(x / 2^24) for 0 < x <= 2^24, as 16.16 fixed point (to within 0.0005)
+static uint32_t neg_ln(uint32_t x)
+{
+	uint8_t shifts = 0, i;
+	uint16_t lo, hi;
+
+	// x / 2^24 = m / 2^(shifts + 1), with m = x / 2^23 in [1, 2)
+	while (x < (1UL << 23)) {
+		x <<= 1;
+		shifts++;
+	}
+	if (x == (1UL << 24)) return 0;
+
+	// interpolate ln(m) between the table entries
+	i = (x >> 19) & 0x0f;
+	lo = pgm_read_word(&LN_TABLE[i]);
+	hi = pgm_read_word(&LN_TABLE[i + 1]);
+	return (shifts + 1) * (uint32_t) LN2 -
+	       (lo + (((hi - lo) * (x & 0x7ffffUL)) >> 19));
+}
+
+
+uint32_t random_geometric(const uint16_t mean)
 {
-	int tmp;
-	const int diff = 1 + max - min;
-	const int buckets = RAND_MAX / diff;
-	const int limit = buckets * diff;
+	uint32_t e, frac, half;
 
-	do {
-		tmp = rand();
-	} while (tmp >= limit);
+	if (mean <= 1) return 1;
 
-	return min + (tmp / buckets);
+	// round down an exponentially distributed time with the same tail:
+	// -ln(u) / -ln(1 - 1/mean) for a uniform `u` in (0, 1], where
+	// 1 / -ln(1 - 1/mean) = mean - 1/2 - 1/(12 mean) - ..., which is
+	// mean - 1/2 to within 1/(12 mean)
+	e = neg_ln((random_u32() >> 8) + 1);
+	frac = mean * (e & 0xffff);
+	half = e >> 1;
+	return mean * (e >> 16) + (frac >> 16) - (half >> 16) -
+	       ((half & 0xffff) > (frac & 0xffff)) + 1;
 }
@@ -1,7 +1,33 @@
 #ifndef RANDOM_H_
 #define RANDOM_H_
 
-/* generate a random integer between `min` and `max` (inclusive) */
-int randint(const int min, const int max);
+/*
+ * Random numbers
+ *
+ * A 32-bit xorshift generator: a few shifts and XORs per number, and no
+ * divisions. Random events are modelled by drawing the time until they
+ * happen once (see random_geometric) and comparing that with the clock,
+ * instead of flipping a coin every second.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// seed the generator (every seed is fine, including 0)
+void random_seed(uint32_t seed);
+
+// 32 random bits
+uint32_t random_u32(void);
+
+// a random integer from 0 up to `n` (exclusive)
+uint16_t random_below(uint16_t n);
+
+// true with a probability of 1 in `n`
+bool random_one_in(uint16_t n);
+
+// the number of seconds (at least 1) until an event that happens with a
+// probability of 1 in `mean` every second, so `mean` seconds on average (in
+// fixed point, without floating point code)
+uint32_t random_geometric(uint16_t mean);
 
 #endif /* RANDOM_H_ */
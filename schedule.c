@@ -0,0 +1,250 @@
+#include "schedule.h"
+#include "calendar.h"
+#include "crc16.h"
+#include "dim.h"
+#include "hal.h"
+#include "journal.h"
+#include "pins.h"
+#include "schedule_default.h"
+#include "trace.h"
+#include <string.h>
+
+#if SCHEDULE_DEFAULT_LEN > SCHEDULE_SIZE
+#error "schedule.txt does not fit in SCHEDULE_SIZE"
+#endif
+
+// the schedule that can be changed over the UART
+uint8_t EEMEM SCHEDULE_EEPROM[SCHEDULE_SIZE] = SCHEDULE_DEFAULT;
+
+// the schedule that we fall back to
+static const uint8_t SCHEDULE_FLASH[] PROGMEM = SCHEDULE_DEFAULT;
+
+static bool use_eeprom = false;
+static uint8_t code_len = 0;
+
+// the result of the last run, which holds on day `cache_yday` of `cache_year`
+// from `cache_from` up to `cache_until` (seconds since midnight)
+static int16_t cache_year = -1, cache_yday = -1;
+static uint32_t cache_from = 0, cache_until = 0;
+static uint16_t cache_steady = 0, cache_flashing = 0;
+static uint8_t cache_levels[LIGHT_COUNT];
+
+// the class of day `cache_yday` of `cache_year`, and of the day before
+static enum calendar_class class_today, class_yesterday;
+
+// today's sunrise and sunset, in minutes since midnight
+static uint16_t sun_rise_min = 6 * 60, sun_set_min = 18 * 60;
+
+static uint32_t runs = 0;
+
+
+static uint8_t code_byte(const uint8_t i)
+{
+	if (use_eeprom) return hal_eeprom_read_byte(&SCHEDULE_EEPROM[i]);
+	return pgm_read_byte(&SCHEDULE_FLASH[i]);
+}
+
+
+static uint16_t code_word(const uint8_t i)
+{
+	return code_byte(i) | (uint16_t) code_byte(i + 1) << 8;
+}
+
+
+bool schedule_load()
+{
+	uint16_t crc = 0xffff;
+	uint8_t len, i;
+
+	use_eeprom = true;
+	cache_yday = -1;
+	len = code_byte(0);
+	if (len <= SCHEDULE_SIZE - 3 && len % SCHEDULE_INSN_SIZE == 0) {
+		for (i = 0; i <= len; i++) crc = crc16_update(crc, code_byte(i));
+		if (crc == code_word(len + 1)) {
+			code_len = len;
+			return true;
+		}
+	}
+	use_eeprom = false;
+	code_len = code_byte(0);
+	return false;
+}
+
+
+// write `data` to `addr` if it differs, once the EEPROM is free: the journal
+// writes from EE_RDY_vect, and ANA_COMP_vect may start a backup at any time,
+// but only in between two bytes of ours
+static void write_byte(uint8_t *addr, const uint8_t data)
+{
+	for (;;) {
+		hal_irq_disable();
+		if (!journal_busy() && hal_eeprom_ready()) break;
+		hal_irq_enable();
+	}
+	if (hal_eeprom_read_byte(addr) != data) hal_eeprom_write_start(addr, data);
+	hal_irq_enable();
+}
+
+
+bool schedule_write(uint8_t offset, const uint8_t *data, uint8_t n)
+{
+	uint8_t i;
+
+	if (offset >= SCHEDULE_SIZE) n = 0;
+	if (n > SCHEDULE_SIZE - offset) n = SCHEDULE_SIZE - offset;
+
+	trace(TRACE_SCHEDULE, offset);
+	for (i = 0; i < n; i++) write_byte(&SCHEDULE_EEPROM[offset + i], data[i]);
+	return schedule_load();
+}
+
+
+void schedule_set_sun(const uint16_t rise, const uint16_t set)
+{
+	if (rise == sun_rise_min && set == sun_set_min) return;
+	sun_rise_min = rise;
+	sun_set_min = set;
+	cache_yday = -1;
+}
+
+
+// a time from the code, in seconds since midnight
+static uint32_t code_time(const uint8_t i)
+{
+	const uint16_t word = code_word(i);
+	int16_t minutes;
+
+	if ((word & SCHEDULE_SUNRISE) == 0) return word * 60L;
+	minutes = (word & SCHEDULE_SUNSET) == SCHEDULE_SUNSET ? sun_set_min :
+	                                                        sun_rise_min;
+	minutes += (int16_t) (word & (SCHEDULE_SUN_BIAS * 2 - 1)) - SCHEDULE_SUN_BIAS;
+	// an offset that goes past midnight stays on the same day
+	if (minutes < 0) minutes = 0;
+	if (minutes >= 24 * 60) minutes = 24 * 60 - 1;
+	return minutes * 60L;
+}
+
+
+// whether a window with `days` starts on weekday `wday`, of class `class`
+static bool starts_on(const uint8_t days, const int8_t wday,
+                      const enum calendar_class class)
+{
+	if (days & SCHEDULE_DAYS_CLASS) return days & 1 << class;
+	return days & 1 << wday;
+}
+
+
+// narrow [cache_from, cache_until) down to the side of `bound` that `t` is on
+static void narrow(const uint32_t t, const uint32_t bound)
+{
+	if (bound <= t) {
+		if (bound > cache_from) cache_from = bound;
+	} else {
+		if (bound < cache_until) cache_until = bound;
+	}
+}
+
+
+static void run(const struct tm *tm, const uint32_t t)
+{
+	const int8_t yesterday = (tm->tm_wday + 6) % 7;
+	uint32_t start, end;
+	uint8_t i, op, light, days;
+	bool active;
+
+	// look the days up in the calendar only once a day (of a year)
+	if (tm->tm_yday != cache_yday || tm->tm_year != cache_year) {
+		class_today = calendar_class(tm->tm_year, tm->tm_yday, tm->tm_wday);
+		class_yesterday = calendar_class(tm->tm_year, tm->tm_yday - 1,
+		                                 yesterday);
+	}
+	cache_year = tm->tm_year;
+	cache_yday = tm->tm_yday;
+	cache_from = 0;
+	cache_until = ONE_DAY;
+	cache_steady = cache_flashing = 0;
+	memset(cache_levels, DIM_MAX, sizeof(cache_levels));
+
+	for (i = 1; i + SCHEDULE_INSN_SIZE <= code_len + 1; i += SCHEDULE_INSN_SIZE) {
+		op = code_byte(i) >> 4;
+		light = code_byte(i) & 0x0f;
+		days = code_byte(i + 1);
+		start = code_time(i + 2);
+		end = code_time(i + 4) + 1; // exclusive
+
+		if (start < end) {
+			active = starts_on(days, tm->tm_wday, class_today) &&
+			         start <= t && t < end;
+		} else {
+			// wraps around midnight
+			active = (starts_on(days, tm->tm_wday, class_today) &&
+			          t >= start) ||
+			         (starts_on(days, yesterday, class_yesterday) && t < end);
+		}
+		narrow(t, start);
+		narrow(t, end);
+
+		if (!active || light >= LIGHT_COUNT) continue;
+		if (op == SCHEDULE_OP_STEADY) {
+			cache_steady |= (uint16_t) 1 << light;
+		} else if (op == SCHEDULE_OP_FLASHING) {
+			cache_flashing |= (uint16_t) 1 << light;
+		} else if ((op & SCHEDULE_OP_DIM) != 0) {
+			cache_levels[light] = (op & SCHEDULE_LEVEL_FULL) * DIM_MAX /
+			                      SCHEDULE_LEVEL_FULL;
+		}
+	}
+	cache_flashing &= ~cache_steady;
+	runs++;
+}
+
+
+static uint32_t day_sec(const struct tm *tm)
+{
+	return tm->tm_hour * 3600L + tm->tm_min * 60 + tm->tm_sec;
+}
+
+
+// whether the last run still holds at `t` on the day of `tm` (the same day of
+// another year, after the clock was set, does not count)
+static bool cached(const struct tm *tm, const uint32_t t)
+{
+	return tm->tm_yday == cache_yday && tm->tm_year == cache_year &&
+	       cache_from <= t && t < cache_until;
+}
+
+
+void schedule_lights(const struct tm *tm, uint16_t *steady, uint16_t *flashing)
+{
+	const uint32_t t = day_sec(tm);
+
+	if (!cached(tm, t)) run(tm, t);
+	*steady = cache_steady;
+	*flashing = cache_flashing;
+}
+
+
+const uint8_t *schedule_levels(const struct tm *tm)
+{
+	const uint32_t t = day_sec(tm);
+
+	if (!cached(tm, t)) run(tm, t);
+	return cache_levels;
+}
+
+
+uint32_t schedule_next_change(const struct tm *tm)
+{
+	const uint32_t t = day_sec(tm);
+
+	if (!cached(tm, t)) run(tm, t);
+	return cache_until - t;
+}
+
+
+void schedule_stats(uint32_t *runs_out, uint8_t *insns)
+{
+	*runs_out = runs;
+	*insns = code_len / SCHEDULE_INSN_SIZE;
+}
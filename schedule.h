@@ -0,0 +1,81 @@
+#ifndef SCHEDULE_H_
+#define SCHEDULE_H_
+
+/*
+ * Light schedule bytecode
+ *
+ * The schedule lives in the EEPROM as a blob of SCHEDULE_SIZE bytes:
+ *
+ *     len | code[len] | crc16
+ *
+ * where the CRC-16 (see crc16.h, little endian) covers `len` and the code.
+ * The code is a list of instructions of SCHEDULE_INSN_SIZE bytes:
+ *
+ *     op << 4 | light, days, start (u16), end (u16)
+ *
+ * `op` is SCHEDULE_OP_STEADY, SCHEDULE_OP_FLASHING or
+ * SCHEDULE_OP_DIM | level, which dims the light to `level` of
+ * SCHEDULE_LEVEL_FULL while the window is active. `days` has bit `tm_wday`
+ * set for every day on which the window starts, or is SCHEDULE_DAYS_CLASS
+ * with bit `class` set for every class of day (see calendar.h) on which it
+ * starts. `start` and `end` are minutes since midnight, or SCHEDULE_SUNRISE
+ * or SCHEDULE_SUNSET plus SCHEDULE_SUN_BIAS plus an offset in minutes (see
+ * schedule_set_sun). A window is active from `start` up to and including the
+ * first second of `end`, and may wrap around midnight.
+ *
+ * tools/mkschedule compiles schedule.txt into such a blob, which also ends up
+ * in flash as the fallback for a broken EEPROM schedule. The interpreter only
+ * runs when the result may change, so a tick costs one comparison.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SCHEDULE_SIZE 128
+#define SCHEDULE_INSN_SIZE 6
+#define SCHEDULE_MAX_INSNS ((SCHEDULE_SIZE - 3) / SCHEDULE_INSN_SIZE)
+
+enum schedule_op {
+	SCHEDULE_OP_STEADY = 1,
+	SCHEDULE_OP_FLASHING = 2,
+	SCHEDULE_OP_DIM = 8
+};
+
+#define SCHEDULE_LEVEL_FULL 7
+
+// `days` is a set of classes of days instead of days of the week
+#define SCHEDULE_DAYS_CLASS 0x80
+
+// times relative to the sun, with offsets from -SCHEDULE_SUN_BIAS minutes
+#define SCHEDULE_SUNRISE 0x8000
+#define SCHEDULE_SUNSET 0xc000
+#define SCHEDULE_SUN_BIAS 0x2000
+
+// check the schedule in the EEPROM and use it, or fall back to the default
+// schedule if it is broken (returns false in that case)
+bool schedule_load();
+
+// overwrite `n` bytes of the EEPROM schedule at `offset` (this blocks until
+// they are written, and needs interrupts enabled), then load it again;
+// returns schedule_load()
+bool schedule_write(uint8_t offset, const uint8_t *data, uint8_t n);
+
+// today's sunrise and sunset in minutes since midnight, for the times that
+// are relative to them
+void schedule_set_sun(uint16_t rise, uint16_t set);
+
+// the lights that are on and the lights that are flashing at `tm`
+void schedule_lights(const struct tm *tm, uint16_t *steady, uint16_t *flashing);
+
+// the brightness of every light at `tm`, from 0 to DIM_MAX (see dim.h)
+const uint8_t *schedule_levels(const struct tm *tm);
+
+// seconds from `tm` until the result of schedule_lights may change
+uint32_t schedule_next_change(const struct tm *tm);
+
+// how often the interpreter ran, and the number of instructions in every run
+// (at most SCHEDULE_MAX_INSNS)
+void schedule_stats(uint32_t *runs, uint8_t *insns);
+
+#endif /* SCHEDULE_H_ */
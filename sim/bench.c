@@ -0,0 +1,337 @@
+/*
+ * Benchmark and differential test of the light logic
+ *
+ * Sweeps every second of several years, and measures the throughput of:
+ * - clock_tick, against the host's localtime_r as the reference (see
+ *   sim/host_tz.h, the simulator's own would use the tz_dst under test);
+ * - tz_dst;
+ * - schedule_lights, which is called twice per second (after sun_times, like
+ *   in main.c);
+ * - lights_binary, which shows the figures of the control mode.
+ *
+ * The results are checked as the sweep runs:
+ * - every broken-down time from clock_tick must equal the host's, in the
+ *   same time zone;
+ * - the schedule's light states (with flashing lights on in the second half
+ *   of each second, whatever their blink pattern in blink.h) must match the
+ *   frozen digests in the reference file.
+ * The digest file has one line per year, with the number of light changes
+ * and an FNV-1a hash of them. `-w` writes a new one, and `-t` prints the
+ * changes in the format of `main_sim -t`, to find where a difference starts.
+ *
+ * K, S, forcing and the control mode are not part of the digests.
+ */
+
+#include "clock.h"
+#include "hal.h"
+#include "host_tz.h"
+#include "lights.h"
+#include "schedule.h"
+#include "sun.h"
+#include "tz.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+#define DEFAULT_FIRST_YEAR 2019
+#define DEFAULT_YEARS 6
+#define MAX_YEARS 100
+
+enum bench_function {
+	BENCH_LOCALTIME, BENCH_CLOCK, BENCH_TZ_DST, BENCH_SCHEDULE, BENCH_BINARY,
+	BENCH_FUNCTIONS
+};
+
+static const char *FUNCTION_NAMES[BENCH_FUNCTIONS] = {
+	"localtime_r", "clock_tick", "tz_dst", "schedule_lights", "lights_binary"
+};
+
+// calls and host seconds per function
+static uint64_t calls[BENCH_FUNCTIONS];
+static double seconds[BENCH_FUNCTIONS];
+
+// one day of broken-down times, from clock_tick and from the host
+static struct tm day_clock[ONE_DAY];
+static struct host_tm day_host[ONE_DAY];
+
+// print every light change
+static bool trace = false;
+
+// keeps the compiler from optimizing the benchmarked calls away
+volatile uint16_t bench_sink;
+
+struct digest {
+	int16_t year;
+	uint32_t changes;
+	uint32_t hash;
+};
+
+
+// the interrupt handlers and the report of the firmware, which the light
+// logic does not need (hal_sim.c refers to them)
+void TIMER2_OVF_vect(void) {}
+void TIMER2_COMP_vect(void) {}
+void INT0_vect(void) {}
+void sim_finish(void) {}
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "usage: %s [-y FIRST_YEAR] [-n YEARS] [-z TZ] [-w] [-t] REFERENCE\n"
+	        "  -y FIRST_YEAR  first year of the sweep (default: %d)\n"
+	        "  -n YEARS       number of years (default: %d)\n"
+	        "  -z TZ          time zone rule (default: %s)\n"
+	        "  -w             write REFERENCE instead of comparing with it\n"
+	        "  -t             print every light change\n",
+	        argv0, DEFAULT_FIRST_YEAR, DEFAULT_YEARS, DEFAULT_TZ);
+	exit(2);
+}
+
+
+static bool tm_equal(const struct tm *a, const struct host_tm *b)
+{
+	return a->tm_sec == b->sec && a->tm_min == b->min &&
+	       a->tm_hour == b->hour && a->tm_mday == b->mday &&
+	       a->tm_wday == b->wday && a->tm_mon == b->mon &&
+	       a->tm_year == b->year && a->tm_yday == b->yday &&
+	       (a->tm_isdst != 0) == b->dst;
+}
+
+
+static void hash_u32(uint32_t *hash, uint32_t value)
+{
+	uint8_t i;
+
+	for (i = 0; i < 4; i++) {
+		*hash = (*hash ^ (value & 0xff)) * 16777619u;
+		value >>= 8;
+	}
+}
+
+
+// like trace_ports in hal_sim.c
+static void print_change(const struct tm *tm, const uint8_t half,
+                         const uint16_t lights)
+{
+	printf("%04d-%02d-%02dT%02d:%02d:%02d.%c PORTB=0x%02x PORTC=0x%02x\n",
+	       1900 + tm->tm_year, tm->tm_mon + 1, tm->tm_mday,
+	       tm->tm_hour, tm->tm_min, tm->tm_sec, half ? '5' : '0',
+	       lights_port_value(HAL_PORTB, lights),
+	       lights_port_value(HAL_PORTC, lights));
+}
+
+
+// sweep the day that starts at `start`, and add its light changes (from
+// `last`) to `d`
+static void sweep_day(const time_t start, struct digest *d, uint16_t *last)
+{
+	uint16_t steady, flashing, lights, rise, set;
+	int32_t z;
+	time_t t;
+	double begin;
+	uint32_t i;
+	uint8_t half;
+
+	// the clock, which was set to `start` - 1 before
+	begin = sim_host_time();
+	for (i = 0; i < ONE_DAY; i++) {
+		system_tick();
+		clock_tick();
+		day_clock[i] = *clock_local();
+	}
+	seconds[BENCH_CLOCK] += sim_host_time() - begin;
+	calls[BENCH_CLOCK] += ONE_DAY;
+
+	begin = sim_host_time();
+	for (i = 0; i < ONE_DAY; i++) {
+		host_localtime((int64_t) start + i + UNIX_OFFSET, &day_host[i]);
+	}
+	seconds[BENCH_LOCALTIME] += sim_host_time() - begin;
+	calls[BENCH_LOCALTIME] += ONE_DAY;
+
+	for (i = 0; i < ONE_DAY; i++) {
+		if (!tm_equal(&day_clock[i], &day_host[i])) {
+			fprintf(stderr, "bench: clock_tick differs from the host's "
+			        "localtime_r at %lu\n",
+			        (unsigned long) (start + i + UNIX_OFFSET));
+			exit(1);
+		}
+	}
+
+	begin = sim_host_time();
+	for (i = 0; i < ONE_DAY; i++) {
+		t = start + i;
+		bench_sink = tz_dst(&t, &z);
+	}
+	seconds[BENCH_TZ_DST] += sim_host_time() - begin;
+	calls[BENCH_TZ_DST] += ONE_DAY;
+
+	begin = sim_host_time();
+	for (i = 0; i < ONE_DAY; i++) {
+		sun_times(start + i, &day_clock[i], &rise, &set);
+		schedule_set_sun(rise, set);
+		for (half = 0; half < 2; half++) {
+			schedule_lights(&day_clock[i], &steady, &flashing);
+			lights = (half == 1) ? steady | flashing : steady;
+			if (lights == *last) continue;
+			*last = lights;
+			if (trace) print_change(&day_clock[i], half, lights);
+			d->changes++;
+			hash_u32(&d->hash, start + i);
+			hash_u32(&d->hash, half);
+			hash_u32(&d->hash, lights);
+		}
+	}
+	seconds[BENCH_SCHEDULE] += sim_host_time() - begin;
+	calls[BENCH_SCHEDULE] += 2 * ONE_DAY;
+
+	begin = sim_host_time();
+	for (i = 0; i < ONE_DAY; i++) {
+		bench_sink = lights_binary(day_clock[i].tm_sec);
+	}
+	seconds[BENCH_BINARY] += sim_host_time() - begin;
+	calls[BENCH_BINARY] += ONE_DAY;
+}
+
+
+// seconds since 2000 at the start of `year` (UTC)
+static time_t year_start(const int16_t year)
+{
+	time_t t = 0;
+	int16_t y;
+
+	for (y = 2000; y < year; y++) t += (365 + is_leap_year(y)) * ONE_DAY;
+	return t;
+}
+
+
+static bool read_reference(const char *filename, struct digest *ref,
+                           uint8_t *count)
+{
+	char line[128];
+	unsigned long changes, hash;
+	int year;
+	FILE *f;
+
+	if ((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return false;
+	}
+	*count = 0;
+	while (fgets(line, sizeof(line), f) != NULL && *count < MAX_YEARS) {
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%d %lu %lx", &year, &changes, &hash) != 3) continue;
+		ref[*count].year = year;
+		ref[*count].changes = changes;
+		ref[*count].hash = hash;
+		(*count)++;
+	}
+	fclose(f);
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct digest digests[MAX_YEARS], ref[MAX_YEARS];
+	const char *tz_str = DEFAULT_TZ, *filename = NULL;
+	int first_year = DEFAULT_FIRST_YEAR, years = DEFAULT_YEARS, i, j;
+	uint8_t ref_count = 0;
+	bool write = false, ok = true;
+	uint16_t last = 0xffff;
+	struct tz_rule tz;
+	time_t start;
+	int16_t day, days;
+	FILE *f;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-y") == 0 && i + 1 < argc) {
+			first_year = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			years = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+			tz_str = argv[++i];
+		} else if (strcmp(argv[i], "-w") == 0) {
+			write = true;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			trace = true;
+		} else if (argv[i][0] != '-' && filename == NULL) {
+			filename = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (filename == NULL || first_year < 2000 || years < 1 ||
+	    years > MAX_YEARS) {
+		usage(argv[0]);
+	}
+	if (!tz_parse(&tz, tz_str)) {
+		fprintf(stderr, "bench: invalid time zone: %s\n", tz_str);
+		return 2;
+	}
+	if (!write && !read_reference(filename, ref, &ref_count)) return 2;
+
+	tz_init(&tz);
+	host_tz_init(tz_str);
+	clock_init(tz.std_offset, tz_dst);
+	// Nijmegen, like in main.c
+	set_position(51.8126 * ONE_DEGREE, 5.8372 * ONE_DEGREE);
+	schedule_load();
+
+	// start one second early, sweep_day ticks before it looks
+	start = year_start(first_year);
+	clock_set(start - 1);
+	for (i = 0; i < years; i++) {
+		digests[i].year = first_year + i;
+		digests[i].changes = 0;
+		digests[i].hash = 2166136261u;
+		last = 0xffff;
+		days = 365 + is_leap_year(first_year + i);
+		for (day = 0; day < days; day++) {
+			sweep_day(start, &digests[i], &last);
+			start += ONE_DAY;
+		}
+	}
+
+	for (i = 0; i < BENCH_FUNCTIONS; i++) {
+		printf("%-16s %12llu calls %8.2f s %12.0f calls/s\n",
+		       FUNCTION_NAMES[i], (unsigned long long) calls[i], seconds[i],
+		       seconds[i] > 0 ? calls[i] / seconds[i] : 0.0);
+	}
+
+	if (write) {
+		if ((f = fopen(filename, "w")) == NULL) {
+			perror(filename);
+			return 2;
+		}
+		fprintf(f, "# year, light changes, hash (written by sim/bench -w)\n");
+		for (i = 0; i < years; i++) {
+			fprintf(f, "%d %lu 0x%08lx\n", digests[i].year,
+			        (unsigned long) digests[i].changes,
+			        (unsigned long) digests[i].hash);
+		}
+		fclose(f);
+		printf("wrote %d years to %s\n", years, filename);
+		return 0;
+	}
+
+	for (i = 0; i < years; i++) {
+		for (j = 0; j < ref_count && ref[j].year != digests[i].year; j++) {}
+		if (j == ref_count) {
+			printf("%d: not in %s\n", digests[i].year, filename);
+			ok = false;
+		} else if (ref[j].changes != digests[i].changes ||
+		           ref[j].hash != digests[i].hash) {
+			printf("%d: %lu changes (0x%08lx), expected %lu (0x%08lx)\n",
+			       digests[i].year, (unsigned long) digests[i].changes,
+			       (unsigned long) digests[i].hash,
+			       (unsigned long) ref[j].changes,
+			       (unsigned long) ref[j].hash);
+			ok = false;
+		}
+	}
+	printf("%s\n", ok ? "light states match the reference" :
+	               "light states DIFFER from the reference");
+	return ok ? 0 : 1;
+}
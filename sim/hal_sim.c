@@ -0,0 +1,568 @@
+#include "hal.h"
+#include "pins.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+uint32_t sim_ticks_left = 0;
+uint32_t sim_ticks = 0;
+uint8_t sim_pins[3] = {0, 0, 0};
+bool sim_trace = false;
+bool sim_watchdog_reset = false;
+FILE *sim_rx = NULL;
+FILE *sim_uart = NULL;
+uint32_t sim_rx_tick = 0;
+uint32_t sim_wakeups = 0;
+uint64_t sim_sleep_counts[2] = {0, 0};
+uint32_t sim_eeprom_writes = 0, sim_eeprom_max_wear = 0;
+
+static uint8_t ports[3] = {0, 0, 0};
+static uint8_t ddrs[3] = {0, 0, 0};
+static bool irq_enabled = false;
+static bool sleep_enabled = false;
+static bool timer2_running = false;
+static bool udre_irq = false;
+static enum hal_sleep_mode sleep_mode = HAL_SLEEP_IDLE;
+static bool rx_enabled = false;
+static uint8_t rx_data;
+static uint8_t powered_off = 0;
+
+
+/* CLOCK AND POWER */
+
+void hal_clock_init() {}
+
+
+void hal_power_off(const uint8_t mask)
+{
+	powered_off |= mask;
+}
+
+
+// a peripheral that was switched off stays off, so the firmware must not use
+// it any more
+static void check_power(const uint8_t peripheral, const char *name)
+{
+	if (powered_off & peripheral) {
+		fprintf(stderr, "sim: %s is used but switched off\n", name);
+		exit(1);
+	}
+}
+
+
+/* GENERAL PURPOSE I/O */
+
+void hal_io_output(const enum hal_port port, const uint8_t mask)
+{
+	ddrs[port] |= mask;
+}
+
+
+void hal_io_input(const enum hal_port port, const uint8_t mask)
+{
+	ddrs[port] &= (uint8_t) ~mask;
+}
+
+
+// the simulated time, as the light trace prints it
+static void trace_time()
+{
+	const time_t now = time(NULL);
+	struct tm tm;
+
+	localtime_r(&now, &tm);
+	fprintf(stderr, "%04d-%02d-%02dT%02d:%02d:%02d.%c",
+	        1900 + tm.tm_year, tm.tm_mon + 1, tm.tm_mday,
+	        tm.tm_hour, tm.tm_min, tm.tm_sec, (sim_ticks & 1) ? '5' : '0');
+}
+
+
+#ifdef LIGHTS_CHAIN
+static void latch_chain();
+#else /* LIGHTS_CHAIN */
+static void trace_ports()
+{
+	trace_time();
+	fprintf(stderr, " PORTB=0x%02x PORTC=0x%02x\n",
+	        ports[HAL_PORTB], ports[HAL_PORTC]);
+}
+#endif /* LIGHTS_CHAIN */
+
+
+void hal_io_write(const enum hal_port port, const uint8_t mask,
+                  const uint8_t value)
+{
+	const uint8_t old = ports[port];
+
+	ports[port] = (uint8_t) (old & ~mask) | (value & mask);
+#ifdef LIGHTS_CHAIN
+	// the lights are on the shift registers, PORTB only has the SPI
+	if (port == CHAIN_LATCH_PORT && (old & 1 << CHAIN_LATCH_BIT) == 0 &&
+	    (ports[port] & 1 << CHAIN_LATCH_BIT) != 0) {
+		latch_chain();
+	}
+#else /* LIGHTS_CHAIN */
+	// PORTD only drives the CPUBUSY led, which changes on every tick
+	if (sim_trace && port != HAL_PORTD && ports[port] != old) {
+		trace_ports();
+	}
+#endif /* LIGHTS_CHAIN */
+}
+
+
+uint8_t hal_io_read(const enum hal_port port)
+{
+	return sim_pins[port];
+}
+
+
+/* UART */
+
+void hal_uart_init()
+{
+	rx_enabled = true;
+}
+
+
+// the simulated UART sends bytes instantly
+bool hal_uart_ready()
+{
+	return true;
+}
+
+
+void hal_uart_write(const uint8_t data)
+{
+	fputc(data, sim_uart);
+}
+
+
+bool hal_uart_tx_done()
+{
+	return true;
+}
+
+
+bool hal_uart_rx_error()
+{
+	return false;
+}
+
+
+uint8_t hal_uart_read()
+{
+	return rx_data;
+}
+
+
+// deliver the next byte from `sim_rx`, returns false if there is none
+static bool uart_receive()
+{
+	int c;
+
+	if (!rx_enabled || sim_rx == NULL || sim_ticks < sim_rx_tick) return false;
+	if ((c = fgetc(sim_rx)) == EOF) {
+		sim_rx = NULL;
+		return false;
+	}
+	// the receiver does not run in power-save mode
+	if (sleep_mode == HAL_SLEEP_POWER_SAVE) return false;
+	rx_data = c;
+	USART_RXC_vect();
+	return true;
+}
+
+
+// run the UDRE interrupt for as long as it is enabled
+static void uart_drain()
+{
+	while (irq_enabled && udre_irq) {
+		USART_UDRE_vect();
+	}
+}
+
+
+void hal_uart_udre_irq(const bool enable)
+{
+	udre_irq = enable;
+	uart_drain();
+}
+
+
+/* SPI */
+
+#ifdef LIGHTS_CHAIN
+// the shift registers of the chain, the one closest to the controller first
+static uint8_t spi_shift[2 * LIGHTS_CHAIN];
+static uint8_t chain_outputs[2 * LIGHTS_CHAIN];
+
+
+// copy the shift registers to the outputs, and trace the indicators that
+// changed
+static void latch_chain()
+{
+	uint8_t i;
+
+	if (sim_trace && memcmp(chain_outputs, spi_shift, sizeof(spi_shift)) != 0) {
+		trace_time();
+		fprintf(stderr, " CHAIN=");
+		for (i = 0; i < LIGHTS_CHAIN; i++) {
+			fprintf(stderr, "%s0x%03x", i > 0 ? "," : "",
+			        spi_shift[2 * i] | (spi_shift[2 * i + 1] & 0x03) << 8);
+		}
+		fprintf(stderr, "\n");
+	}
+	memcpy(chain_outputs, spi_shift, sizeof(spi_shift));
+}
+#endif /* LIGHTS_CHAIN */
+
+
+void hal_spi_init()
+{
+	check_power(HAL_POWER_SPI, "the SPI");
+}
+
+
+void hal_spi_write(const uint8_t data)
+{
+#ifdef LIGHTS_CHAIN
+	memmove(spi_shift + 1, spi_shift, sizeof(spi_shift) - 1);
+	spi_shift[0] = data;
+#else /* LIGHTS_CHAIN */
+	(void) data;
+#endif /* LIGHTS_CHAIN */
+}
+
+
+/* EEPROM */
+
+// writes per EEPROM byte
+#define EEPROM_SIZE 512
+static struct {
+	const uint8_t *addr;
+	uint32_t writes;
+} wear[EEPROM_SIZE];
+static bool eeprom_irq = false;
+
+
+uint8_t hal_eeprom_read_byte(const uint8_t *addr)
+{
+	return *addr;
+}
+
+
+void hal_eeprom_read_block(void *dst, const void *src, const size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+
+// the simulated EEPROM writes instantly
+bool hal_eeprom_ready()
+{
+	return true;
+}
+
+
+void hal_eeprom_write_start(uint8_t *addr, const uint8_t data)
+{
+	unsigned i;
+
+	*addr = data;
+	sim_eeprom_writes++;
+	for (i = 0; i < EEPROM_SIZE && wear[i].addr != NULL; i++) {
+		if (wear[i].addr == addr) break;
+	}
+	if (i == EEPROM_SIZE) {
+		fprintf(stderr, "sim: more than %d EEPROM bytes written\n", EEPROM_SIZE);
+		exit(1);
+	}
+	wear[i].addr = addr;
+	if (++wear[i].writes > sim_eeprom_max_wear) {
+		sim_eeprom_max_wear = wear[i].writes;
+	}
+}
+
+
+// run the EE_RDY interrupt for as long as it is enabled
+static void eeprom_drain()
+{
+	while (irq_enabled && eeprom_irq) {
+		EE_RDY_vect();
+	}
+}
+
+
+void hal_eeprom_ready_irq(const bool enable)
+{
+	eeprom_irq = enable;
+	eeprom_drain();
+}
+
+
+/* TIMERS AND INTERRUPTS */
+
+// Timer2 counts since the start of the simulation
+static uint64_t count = 0;
+static bool alarm_enabled = false;
+static uint8_t alarm_at;
+static bool int0_enabled = false;
+static bool int0_flag = false;
+
+// scripted CONTROL button presses, in Timer2 counts
+#define MAX_PRESSES 64
+static struct {
+	uint64_t start, end;
+} presses[MAX_PRESSES];
+static unsigned press_count = 0, press_next = 0;
+
+
+void sim_press(const uint64_t start, const uint32_t length)
+{
+	if (press_count == MAX_PRESSES) {
+		fprintf(stderr, "sim: too many button presses\n");
+		exit(2);
+	}
+	presses[press_count].start = start;
+	presses[press_count].end = start + length;
+	press_count++;
+}
+
+
+// the supply is low from `supply_low_start` up to `supply_low_end`, in Timer2
+// counts; `supply_dropped` is set once the comparator has seen it drop
+static uint64_t supply_low_start = 0, supply_low_end = 0;
+static bool comparator_enabled = false, supply_dropped = false;
+
+
+void sim_supply_low(const uint64_t start, const uint32_t length)
+{
+	supply_low_start = start;
+	supply_low_end = start + length;
+}
+
+
+void hal_comparator_init()
+{
+	check_power(HAL_POWER_COMPARATOR, "the analog comparator");
+	comparator_enabled = true;
+}
+
+
+bool hal_comparator_low()
+{
+	check_power(HAL_POWER_COMPARATOR, "the analog comparator");
+	return count >= supply_low_start && count < supply_low_end;
+}
+
+
+// Timer0 only times the bit planes of the dimming (see dim.h), which are
+// much shorter than a tick; in the simulation the lights stay fully on
+void hal_timer0_start()
+{
+	check_power(HAL_POWER_TIMER0, "Timer0");
+}
+
+
+void hal_timer0_stop() {}
+void hal_timer0_next(const uint8_t counts) {}
+
+
+// without the bit planes, show the lights fully on right away
+void hal_timer0_preview(const enum hal_port port, const uint8_t mask,
+                        const uint8_t value)
+{
+	hal_io_write(port, mask, value);
+}
+
+
+void hal_timer2_init()
+{
+	timer2_running = true;
+}
+
+
+uint8_t hal_timer2_count()
+{
+	return count & 0xff;
+}
+
+
+void hal_timer2_alarm(const uint8_t at)
+{
+	alarm_at = at;
+	alarm_enabled = true;
+}
+
+
+void hal_timer2_alarm_off()
+{
+	alarm_enabled = false;
+}
+
+
+// no jitter in the simulator, so that every run is the same
+uint32_t hal_entropy()
+{
+	return 0;
+}
+
+
+void hal_int0_init()
+{
+	int0_enabled = true;
+}
+
+
+void hal_int0_enable(const bool enable)
+{
+	int0_enabled = enable;
+}
+
+
+void hal_irq_enable()
+{
+	irq_enabled = true;
+	uart_drain();
+	eeprom_drain();
+}
+
+
+void hal_irq_disable()
+{
+	irq_enabled = false;
+}
+
+
+bool hal_irq_enabled()
+{
+	return irq_enabled;
+}
+
+
+void hal_sleep_enable()
+{
+	sleep_enabled = true;
+}
+
+
+void hal_sleep_mode(const enum hal_sleep_mode mode)
+{
+	sleep_mode = mode;
+}
+
+
+// the next count at which the CONTROL button changes, or 0 for never
+static uint64_t next_edge()
+{
+	if (press_next == press_count) return 0;
+	if (count < presses[press_next].start) return presses[press_next].start;
+	return presses[press_next].end;
+}
+
+
+// move the button to where it should be at `count`
+static void update_button()
+{
+	const uint8_t old = sim_pins[CONTROL_BUTTON_PORT];
+
+	if (press_next < press_count && count >= presses[press_next].end) {
+		press_next++;
+	}
+	if (press_next < press_count && count >= presses[press_next].start) {
+		sim_pins[CONTROL_BUTTON_PORT] |= 1 << CONTROL_BUTTON_BIT;
+	} else {
+		sim_pins[CONTROL_BUTTON_PORT] &= (uint8_t) ~(1 << CONTROL_BUTTON_BIT);
+	}
+	// edges are only seen while the I/O clock runs
+	if (sim_pins[CONTROL_BUTTON_PORT] != old && sleep_mode == HAL_SLEEP_IDLE) {
+		int0_flag = true;
+	}
+}
+
+
+void hal_sleep()
+{
+	uint64_t next, edge, alarm;
+
+	if (!sleep_enabled || !timer2_running) {
+		fprintf(stderr, "sim: sleeping without a wake-up source\n");
+		exit(1);
+	}
+	hal_irq_enable();
+
+	// a received byte or a pending edge wakes us up right away
+	if (uart_receive()) return;
+	if (int0_flag && int0_enabled) {
+		int0_flag = false;
+		INT0_vect();
+		return;
+	}
+
+	// otherwise, skip to the next timer interrupt or button edge
+	next = (count | 0xff) + 1;
+	alarm = count + (uint8_t) (alarm_at - count) + 1;
+	if (alarm_enabled && alarm < next) next = alarm;
+	edge = next_edge();
+	if (edge != 0 && edge < next) next = edge;
+	// the comparator interrupt only wakes us up from idle mode
+	if (comparator_enabled && !supply_dropped && sleep_mode == HAL_SLEEP_IDLE &&
+	    supply_low_end != 0 && supply_low_start > count &&
+	    supply_low_start < next) {
+		next = supply_low_start;
+	}
+
+	if (next == (count | 0xff) + 1 && sim_ticks_left == 0) {
+		sim_finish();
+	}
+	sim_wakeups++;
+	sim_sleep_counts[sleep_mode] += next - count;
+	count = next;
+	update_button();
+	if (int0_flag && int0_enabled) {
+		int0_flag = false;
+		INT0_vect();
+	}
+	if (alarm_enabled && count == alarm) {
+		TIMER2_COMP_vect();
+	}
+#ifdef ENABLE_POWER_FAIL
+	if (comparator_enabled && !supply_dropped && supply_low_end != 0 &&
+	    count >= supply_low_start) {
+		supply_dropped = true;
+		ANA_COMP_vect();
+	}
+#endif /* ENABLE_POWER_FAIL */
+	if ((count & 0xff) == 0) {
+		sim_ticks_left--;
+		sim_ticks++;
+		TIMER2_OVF_vect();
+	}
+}
+
+
+void hal_delay_ms(const double ms)
+{
+	// the simulated clock only moves on Timer2 overflows
+	(void) ms;
+}
+
+
+/* WATCHDOG */
+
+bool hal_reset_by_watchdog()
+{
+	return sim_watchdog_reset;
+}
+
+
+#ifdef ENABLE_WATCHDOG
+void hal_wdt_enable()
+{
+}
+
+
+void hal_wdt_reset()
+{
+}
+#endif /* ENABLE_WATCHDOG */
@@ -0,0 +1,146 @@
+#ifndef HAL_SIM_H_
+#define HAL_SIM_H_
+
+/*
+ * Host implementation of the hardware abstraction layer (see hal.h)
+ *
+ * Instead of sleeping, `hal_sleep` skips straight to the next simulated
+ * interrupt (a Timer2 overflow or compare match, or an edge of the CONTROL
+ * button), so the firmware runs as fast as the host allows. The simulation
+ * ends (and the process exits) when `sim_ticks_left` reaches zero.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// the simulated EEPROM is plain memory
+#define EEMEM
+
+// and so is the simulated flash
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *) (addr))
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define PSTR(str) (str)
+
+// and the simulated RAM starts out cleared
+#define NOINIT
+
+// interrupt handlers become normal functions that the simulator calls
+#define ISR(vector) void vector(void)
+void TIMER0_OVF_vect(void);
+void TIMER2_OVF_vect(void);
+void TIMER2_COMP_vect(void);
+void INT0_vect(void);
+void USART_UDRE_vect(void);
+void USART_RXC_vect(void);
+void EE_RDY_vect(void);
+void ANA_COMP_vect(void);
+
+void hal_clock_init();
+void hal_power_off(const uint8_t mask);
+
+void hal_io_output(const enum hal_port port, const uint8_t mask);
+void hal_io_input(const enum hal_port port, const uint8_t mask);
+void hal_io_write(const enum hal_port port, const uint8_t mask,
+                  const uint8_t value);
+uint8_t hal_io_read(const enum hal_port port);
+
+void hal_uart_init();
+bool hal_uart_ready();
+void hal_uart_write(const uint8_t data);
+bool hal_uart_tx_done();
+bool hal_uart_rx_error();
+uint8_t hal_uart_read();
+void hal_uart_udre_irq(const bool enable);
+
+void hal_spi_init();
+void hal_spi_write(const uint8_t data);
+
+uint8_t hal_eeprom_read_byte(const uint8_t *addr);
+void hal_eeprom_read_block(void *dst, const void *src, const size_t n);
+bool hal_eeprom_ready();
+void hal_eeprom_write_start(uint8_t *addr, const uint8_t data);
+void hal_eeprom_ready_irq(const bool enable);
+
+void hal_comparator_init();
+bool hal_comparator_low();
+
+void hal_timer2_init();
+uint8_t hal_timer2_count();
+void hal_timer2_alarm(const uint8_t at);
+void hal_timer2_alarm_off();
+void hal_timer0_start();
+void hal_timer0_stop();
+void hal_timer0_next(const uint8_t counts);
+void hal_timer0_preview(const enum hal_port port, const uint8_t mask,
+                        const uint8_t value);
+void hal_timer1_init();
+uint16_t hal_timer1_count();
+uint32_t hal_entropy();
+void hal_int0_init();
+void hal_int0_enable(const bool enable);
+void hal_irq_enable();
+void hal_irq_disable();
+bool hal_irq_enabled();
+void hal_sleep_enable();
+void hal_sleep_mode(const enum hal_sleep_mode mode);
+void hal_sleep();
+void hal_delay_ms(const double ms);
+
+bool hal_reset_by_watchdog();
+
+#ifdef ENABLE_WATCHDOG
+void hal_wdt_enable();
+void hal_wdt_reset();
+#endif /* ENABLE_WATCHDOG */
+
+
+/* SIMULATOR STATE */
+
+// number of Timer2 overflows that are still to be simulated
+extern uint32_t sim_ticks_left;
+
+// number of Timer2 overflows that have been simulated
+extern uint32_t sim_ticks;
+
+// input pin levels
+extern uint8_t sim_pins[3];
+
+// print a line to stderr whenever a light changes
+extern bool sim_trace;
+
+// start as if the watchdog reset the microcontroller
+extern bool sim_watchdog_reset;
+
+// hold the CONTROL button from `start` for `length` (in Timer2 counts since
+// the start of the simulation); presses must be added in order
+void sim_press(uint64_t start, uint32_t length);
+
+// let the supply drop below the power-fail threshold from `start` for
+// `length` (in Timer2 counts since the start of the simulation)
+void sim_supply_low(uint64_t start, uint32_t length);
+
+// bytes that are received on the UART (one per wake-up), starting at tick
+// `sim_rx_tick`
+extern FILE *sim_rx;
+extern uint32_t sim_rx_tick;
+
+// number of wake-ups, and the Timer2 counts spent in each sleep mode
+extern uint32_t sim_wakeups;
+extern uint64_t sim_sleep_counts[2];
+
+// number of EEPROM writes, in total and to the most written byte
+extern uint32_t sim_eeprom_writes, sim_eeprom_max_wear;
+
+// print a report and exit (implemented in sim.c)
+void sim_finish(void);
+
+// where the UART output goes
+extern FILE *sim_uart;
+
+// seconds on the host's clock (see timer1.c)
+double sim_host_time();
+
+#endif /* HAL_SIM_H_ */
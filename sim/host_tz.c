@@ -0,0 +1,40 @@
+#define _GNU_SOURCE
+#include "host_tz.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// the C library's localtime_r, behind the one of sim/time.c
+static struct tm *(*libc_localtime_r)(const time_t *, struct tm *);
+
+
+void host_tz_init(const char *tz)
+{
+	setenv("TZ", tz, 1);
+	tzset();
+	*(void **) &libc_localtime_r = dlsym(RTLD_NEXT, "localtime_r");
+	if (libc_localtime_r == NULL) {
+		fprintf(stderr, "bench: no localtime_r in the C library: %s\n",
+		        dlerror());
+		exit(1);
+	}
+}
+
+
+void host_localtime(int64_t unix_time, struct host_tm *tm)
+{
+	const time_t t = unix_time;
+	struct tm host;
+
+	libc_localtime_r(&t, &host);
+	tm->sec = host.tm_sec;
+	tm->min = host.tm_min;
+	tm->hour = host.tm_hour;
+	tm->mday = host.tm_mday;
+	tm->mon = host.tm_mon;
+	tm->year = host.tm_year;
+	tm->wday = host.tm_wday;
+	tm->yday = host.tm_yday;
+	tm->dst = host.tm_isdst > 0;
+}
@@ -0,0 +1,28 @@
+#ifndef SIM_HOST_TZ_H_
+#define SIM_HOST_TZ_H_
+
+/*
+ * The host's own local time, as an independent reference for sim/bench.c
+ *
+ * sim/time.c replaces localtime_r for the firmware, and it converts with the
+ * tz_dst that the bench tests. This file is compiled without sim/ on the
+ * include path, and asks the C library of the host for its localtime_r, with
+ * TZ set to the same POSIX rule. It does not use the host's struct tm in its
+ * interface, because the bench sees the one of sim/time.h.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct host_tm {
+	int sec, min, hour, mday, mon, year, wday, yday;
+	bool dst;
+};
+
+// use the POSIX time zone rule `tz` (exits when the host has no localtime_r)
+void host_tz_init(const char *tz);
+
+// the local time at `unix_time` (seconds since 1970)
+void host_localtime(int64_t unix_time, struct host_tm *tm);
+
+#endif /* SIM_HOST_TZ_H_ */
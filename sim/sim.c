@@ -0,0 +1,128 @@
+/*
+ * Fast-forward simulator for the liftlighter firmware
+ *
+ * Runs `main.c` on the host, replacing the 0.5 second Timer2 overflows with
+ * back-to-back calls of the interrupt handler. UART output is written to
+ * stdout, simulator messages (and the light trace) go to stderr.
+ */
+
+#include "hal.h"
+#include "journal.h"
+#include "pins.h"
+#include "schedule.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/times.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// the firmware's main(), renamed by the Makefile
+int firmware_main(void);
+
+static uint32_t sim_days = 1;
+static clock_t start_clock;
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "usage: %s [-s UNIX_TIME] [-d DAYS] [-S] [-t] [-B SECONDS:MS]...\n"
+	        "       %*s [-P SECONDS:LENGTH] [-W] [-R FILE [-r SECONDS]]\n"
+	        "  -s UNIX_TIME  start the clock at UNIX_TIME (default: empty EEPROM)\n"
+	        "  -d DAYS       number of days to simulate (default: 1)\n"
+	        "  -S            close the S switch\n"
+	        "  -B SECONDS:MS press the CONTROL button after SECONDS, for MS\n"
+	        "  -P SECONDS:LENGTH\n"
+	        "                let the supply fail after SECONDS, for LENGTH seconds\n"
+	        "                (with ENABLE_POWER_FAIL)\n"
+	        "  -t            trace light changes to stderr\n"
+	        "  -W            start as after a watchdog reset (with ENABLE_TRACE,\n"
+	        "                the trace is sent right away)\n"
+	        "  -R FILE       receive the bytes in FILE on the UART\n"
+	        "  -r SECONDS    start receiving after SECONDS (default: 0)\n",
+	        argv0, (int) strlen(argv0), "");
+	exit(2);
+}
+
+
+void sim_finish(void)
+{
+	struct tms buf;
+	const double cpu = (double) (times(&buf) - start_clock) /
+	                   (double) sysconf(_SC_CLK_TCK);
+	uint32_t runs;
+	uint8_t insns;
+
+	fflush(stdout);
+	fflush(sim_uart);
+	fprintf(stderr, "sim: %lu ticks (%lu days) in %.2f s",
+	        (unsigned long) sim_ticks, (unsigned long) sim_days, cpu);
+	if (cpu > 0) {
+		fprintf(stderr, ", %.0f ticks/s", (double) sim_ticks / cpu);
+	}
+	fprintf(stderr, "\n");
+	fprintf(stderr, "sim: %lu EEPROM writes, at most %lu to one byte\n",
+	        (unsigned long) sim_eeprom_writes,
+	        (unsigned long) sim_eeprom_max_wear);
+	fprintf(stderr, "sim: %lu wake-ups, %.1f%% of the time in power-save\n",
+	        (unsigned long) sim_wakeups,
+	        100.0 * (double) sim_sleep_counts[HAL_SLEEP_POWER_SAVE] /
+	        (double) (sim_sleep_counts[HAL_SLEEP_IDLE] +
+	                  sim_sleep_counts[HAL_SLEEP_POWER_SAVE] + 1));
+	schedule_stats(&runs, &insns);
+	fprintf(stderr, "sim: %lu schedule runs of %u instructions\n",
+	        (unsigned long) runs, insns);
+	exit(0);
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct tms buf;
+	double start;
+	unsigned long length;
+	char *end;
+	int i;
+
+	sim_uart = stdout;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			// put the time in the (simulated) EEPROM journal
+			journal_write(strtoul(argv[++i], NULL, 10) - UNIX_OFFSET, 0);
+			while (journal_busy()) EE_RDY_vect();
+		} else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+			sim_days = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-S") == 0) {
+			sim_pins[S_SWITCH_PORT] |= 1 << S_SWITCH_BIT;
+		} else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+			start = strtod(argv[++i], &end);
+			if (*end != ':') usage(argv[0]);
+			length = strtoul(end + 1, NULL, 10);
+			sim_press(start * HAL_TIMER2_HZ, length * HAL_TIMER2_HZ / 1000);
+		} else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+			start = strtod(argv[++i], &end);
+			if (*end != ':') usage(argv[0]);
+			length = strtoul(end + 1, NULL, 10);
+			sim_supply_low(start * HAL_TIMER2_HZ, length * HAL_TIMER2_HZ);
+		} else if (strcmp(argv[i], "-t") == 0) {
+			sim_trace = true;
+		} else if (strcmp(argv[i], "-W") == 0) {
+			sim_watchdog_reset = true;
+		} else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+			if ((sim_rx = fopen(argv[++i], "rb")) == NULL) {
+				perror(argv[i]);
+				exit(1);
+			}
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			sim_rx_tick = 2 * strtoul(argv[++i], NULL, 10);
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	// two Timer2 overflows per second
+	sim_ticks_left = sim_days * 2 * ONE_DAY;
+	start_clock = times(&buf);
+	return firmware_main();
+}
@@ -0,0 +1,208 @@
+#include "time.h"
+#include <math.h>
+#include <stdio.h>
+
+static time_t system_time = 0;
+static int32_t utc_offset = 0;
+static int (*dst_ptr)(const time_t *, int32_t *) = NULL;
+static int32_t latitude = 0, longitude = 0;
+
+#define PI 3.14159265358979
+
+static const char DAY_NAMES[] = "SunMonTueWedThuFriSat";
+static const char MONTH_NAMES[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+
+uint8_t is_leap_year(int16_t year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+
+uint8_t month_length(int16_t year, uint8_t month)
+{
+	if (month == 2) return 28 + is_leap_year(year);
+	if (month == 4 || month == 6 || month == 9 || month == 11) return 30;
+	return 31;
+}
+
+
+time_t time(time_t *timer)
+{
+	if (timer != NULL) *timer = system_time;
+	return system_time;
+}
+
+
+void set_system_time(time_t timestamp)
+{
+	system_time = timestamp;
+}
+
+
+void system_tick(void)
+{
+	system_time++;
+}
+
+
+void set_dst(int (*d_func)(const time_t *, int32_t *))
+{
+	dst_ptr = d_func;
+}
+
+
+void set_zone(int32_t z)
+{
+	utc_offset = z;
+}
+
+
+void set_position(int32_t lat, int32_t lon)
+{
+	latitude = lat;
+	longitude = lon;
+}
+
+
+// sunrise (`sign` -1) or sunset (1) on the UTC day of `timer`, with NOAA's
+// approximation; this is within a minute or two of avr-libc's
+static time_t sun_event(const time_t *timer, const int sign)
+{
+	const double rad = PI / 180;
+	const double lat = latitude / (double) ONE_DEGREE * rad;
+	const double lon = longitude / (double) ONE_DEGREE;
+	struct tm tm;
+	double g, eqtime, decl, cos_ha, ha, minutes;
+
+	gmtime_r(timer, &tm);
+	g = 2 * PI / (365 + is_leap_year(1900 + tm.tm_year)) * tm.tm_yday;
+	eqtime = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g) -
+	                   0.014615 * cos(2 * g) - 0.040849 * sin(2 * g));
+	decl = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g) -
+	       0.006758 * cos(2 * g) + 0.000907 * sin(2 * g) -
+	       0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+	cos_ha = cos(90.833 * rad) / (cos(lat) * cos(decl)) - tan(lat) * tan(decl);
+	ha = acos(cos_ha < -1 ? -1 : cos_ha > 1 ? 1 : cos_ha) / rad;
+	minutes = 720 - 4 * (lon - sign * ha) - eqtime;
+	return *timer - *timer % ONE_DAY + (time_t) lround(minutes * 60);
+}
+
+
+time_t sun_rise(const time_t *timer)
+{
+	return sun_event(timer, -1);
+}
+
+
+time_t sun_set(const time_t *timer)
+{
+	return sun_event(timer, 1);
+}
+
+
+void gmtime_r(const time_t *timer, struct tm *timeptr)
+{
+	uint32_t t = *timer;
+	uint32_t days;
+	int16_t year = 2000;
+	uint8_t month = 1;
+
+	timeptr->tm_sec = t % 60;
+	t /= 60;
+	timeptr->tm_min = t % 60;
+	t /= 60;
+	timeptr->tm_hour = t % 24;
+	days = t / 24;
+
+	// 2000-01-01 was a Saturday
+	timeptr->tm_wday = (days + SATURDAY) % 7;
+
+	while (days >= 365u + is_leap_year(year)) {
+		days -= 365u + is_leap_year(year);
+		year++;
+	}
+	timeptr->tm_yday = days;
+	while (days >= month_length(year, month)) {
+		days -= month_length(year, month);
+		month++;
+	}
+	timeptr->tm_year = year - 1900;
+	timeptr->tm_mon = month - 1;
+	timeptr->tm_mday = days + 1;
+	timeptr->tm_isdst = 0;
+}
+
+
+struct tm *gmtime(const time_t *timer)
+{
+	static struct tm tm;
+	gmtime_r(timer, &tm);
+	return &tm;
+}
+
+
+void localtime_r(const time_t *timer, struct tm *timeptr)
+{
+	time_t lt = *timer + utc_offset;
+	int dst = 0;
+
+	if (dst_ptr != NULL) {
+		dst = dst_ptr(timer, &utc_offset);
+		lt += dst;
+	}
+	gmtime_r(&lt, timeptr);
+	timeptr->tm_isdst = dst;
+}
+
+
+struct tm *localtime(const time_t *timer)
+{
+	static struct tm tm;
+	localtime_r(timer, &tm);
+	return &tm;
+}
+
+
+// interpret `timeptr` as local time (like avr-libc, tm_isdst < 0 means unknown)
+time_t mktime(struct tm *timeptr)
+{
+	const int16_t year = 1900 + timeptr->tm_year;
+	int32_t days = 0;
+	time_t ret;
+	int16_t y;
+	uint8_t m;
+
+	for (y = 2000; y < year; y++) days += 365 + is_leap_year(y);
+	for (m = 1; m < timeptr->tm_mon + 1; m++) days += month_length(year, m);
+	days += timeptr->tm_mday - 1;
+
+	ret = (time_t) (days * ONE_DAY + timeptr->tm_hour * 3600L +
+	                timeptr->tm_min * 60L + timeptr->tm_sec);
+	if (timeptr->tm_isdst < 0 && dst_ptr != NULL) {
+		timeptr->tm_isdst = dst_ptr(&ret, &utc_offset);
+	}
+	if (timeptr->tm_isdst > 0) ret -= timeptr->tm_isdst;
+	ret -= utc_offset;
+
+	localtime_r(&ret, timeptr);
+	return ret;
+}
+
+
+char *asctime(const struct tm *timeptr)
+{
+	static char buf[40];
+	snprintf(buf, sizeof(buf), "%.3s %.3s %02d %02d:%02d:%02d %d",
+	         &DAY_NAMES[3 * timeptr->tm_wday],
+	         &MONTH_NAMES[3 * timeptr->tm_mon],
+	         timeptr->tm_mday, timeptr->tm_hour, timeptr->tm_min,
+	         timeptr->tm_sec, 1900 + timeptr->tm_year);
+	return buf;
+}
+
+
+char *ctime(const time_t *timer)
+{
+	return asctime(localtime(timer));
+}
@@ -0,0 +1,63 @@
+#ifndef SIM_TIME_H_
+#define SIM_TIME_H_
+
+/*
+ * Host stand-in for the part of avr-libc's <time.h> that the firmware uses.
+ *
+ * Like on the target, `time_t` counts seconds since 2000-01-01 00:00 UTC and
+ * the system clock only moves when `system_tick` is called. The simulator
+ * puts this directory in front of the include path, so `#include <time.h>`
+ * picks up this file instead of the host's.
+ */
+
+#include <stdint.h>
+
+typedef uint32_t time_t;
+
+struct tm {
+	int8_t tm_sec;
+	int8_t tm_min;
+	int8_t tm_hour;
+	int8_t tm_mday;
+	int8_t tm_wday;
+	int8_t tm_mon;
+	int16_t tm_year;
+	int16_t tm_yday;
+	int16_t tm_isdst;
+};
+
+#define UNIX_OFFSET 946684800
+#define ONE_HOUR 3600
+#define ONE_DEGREE 3600
+#define ONE_DAY 86400
+
+enum _WEEK_DAYS_ {
+	SUNDAY, MONDAY, TUESDAY, WEDNESDAY, THURSDAY, FRIDAY, SATURDAY
+};
+
+enum _MONTHS_ {
+	JANUARY, FEBRUARY, MARCH, APRIL, MAY, JUNE,
+	JULY, AUGUST, SEPTEMBER, OCTOBER, NOVEMBER, DECEMBER
+};
+
+time_t time(time_t *timer);
+time_t mktime(struct tm *timeptr);
+struct tm *gmtime(const time_t *timer);
+void gmtime_r(const time_t *timer, struct tm *timeptr);
+struct tm *localtime(const time_t *timer);
+void localtime_r(const time_t *timer, struct tm *timeptr);
+char *asctime(const struct tm *timeptr);
+char *ctime(const time_t *timer);
+
+void set_system_time(time_t timestamp);
+void system_tick(void);
+void set_dst(int (*d_func)(const time_t *, int32_t *));
+void set_zone(int32_t z);
+void set_position(int32_t lat, int32_t lon);
+time_t sun_rise(const time_t *timer);
+time_t sun_set(const time_t *timer);
+
+uint8_t is_leap_year(int16_t year);
+uint8_t month_length(int16_t year, uint8_t month);
+
+#endif /* SIM_TIME_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Timer1 as a cycle counter, running on the host's clock, and the host's
+ * clock itself for benchmarks
+ *
+ * This file does not include hal.h, because the host's <sys/time.h> brings its
+ * own time_t, which clashes with the one in the simulated <time.h>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+
+void hal_timer1_init()
+{
+}
+
+
+// host microseconds, which is what Timer1 counts on a 1 MHz MCU
+uint16_t hal_timer1_count()
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (uint16_t) (now.tv_sec * 1000000 + now.tv_usec);
+}
+
+
+// seconds on the host's clock
+double sim_host_time()
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec / 1e6;
+}
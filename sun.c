@@ -0,0 +1,34 @@
+#include "sun.h"
+
+// the day of the cached times
+static int16_t cache_year = -1, cache_yday = -1;
+static uint16_t cache_rise, cache_set;
+
+
+// minutes from `midnight` to `t`, within the day (the sun may not rise or set
+// at all near the poles)
+static uint16_t minutes_since(const time_t midnight, const time_t t)
+{
+	if (t < midnight) return 0;
+	if (t - midnight >= ONE_DAY - 30) return 24 * 60 - 1;
+	return (t - midnight + 30) / 60;
+}
+
+
+void sun_times(const time_t now, const struct tm *local, uint16_t *rise,
+               uint16_t *set)
+{
+	time_t midnight, noon;
+
+	if (local->tm_yday != cache_yday || local->tm_year != cache_year) {
+		midnight = now - (local->tm_hour * 3600L + local->tm_min * 60 +
+		                  local->tm_sec);
+		noon = midnight + 12 * ONE_HOUR;
+		cache_rise = minutes_since(midnight, sun_rise(&noon));
+		cache_set = minutes_since(midnight, sun_set(&noon));
+		cache_year = local->tm_year;
+		cache_yday = local->tm_yday;
+	}
+	*rise = cache_rise;
+	*set = cache_set;
+}
@@ -0,0 +1,20 @@
+#ifndef SUN_H_
+#define SUN_H_
+
+/*
+ * Sunrise and sunset
+ *
+ * avr-libc's sun_rise and sun_set (for the position from set_position) cost
+ * a lot of floating point, so sun_times only calls them when the local day
+ * changes. On every other call it costs a comparison.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+// the sunrise and the sunset on the local day `local` (which is the local
+// time of `now`), in minutes since local midnight
+void sun_times(time_t now, const struct tm *local, uint16_t *rise,
+               uint16_t *set);
+
+#endif /* SUN_H_ */
@@ -0,0 +1,668 @@
+/*
+ * Static stack depth and cycle bounds for the AVR firmware
+ *
+ *     avr-objdump -d main > main.lst
+ *     avrwcet -s 384 -c 1000 main.lst *.su
+ *
+ * Reads the disassembly and the stack usage files from -fstack-usage, builds
+ * the call graph (interrupt handlers included) and prints for every function:
+ * - its own stack frame (from the .su file, or else from its pushes);
+ * - the deepest stack of any call path from it;
+ * - a bound on the cycles of any path from it, callees included.
+ *
+ * The cycle bound is the longest path through the function with the loops
+ * cut open, using the worst-case cycles of every instruction. A function
+ * with a loop only gets a bound from a hint `-l FUNC=N`, which says that its
+ * loops go back at most N times together; the bound is then N + 1 times the
+ * longest path. Indirect calls (icall) need a hint `-i FUNC=CALLEE` for
+ * every function they may call. Without hints such functions, and all their
+ * callers, are reported as unbounded.
+ *
+ * The interrupt handlers (__vector_N) do not nest, so the stack budget (-s)
+ * is checked against the depth of main plus the deepest handler. The cycle
+ * budget (-c) is checked for every root (-r, by default all handlers),
+ * interrupt response included. The exit status is 1 when a budget is
+ * exceeded or a root has no bound.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FUNCS 1024
+#define MAX_INSNS 32768
+#define MAX_HINTS 64
+#define MAX_ROOTS 32
+#define NAME_SIZE 64
+
+// no bound (a loop without a hint, recursion or an unresolved jump)
+#define NO_BOUND UINT32_MAX
+
+// cycles from an interrupt to the first instruction of its handler: the
+// response time and the jump in the vector table
+#define ISR_ENTRY_CYCLES (4 + 3)
+
+struct insn {
+	uint32_t addr;
+	uint8_t size;
+	char op[8];
+	bool has_target;
+	uint32_t target;
+};
+
+struct func {
+	char name[NAME_SIZE];
+	uint32_t first, count;     // instructions
+	int32_t su;                // bytes from the .su file, or -1
+	int32_t loop_bound;        // from a hint, or -1
+	uint8_t stack_state, cycle_state; // 0: to do, 1: busy, 2: done
+	uint32_t stack, depth;     // own frame and deepest path
+	uint32_t *path;            // bound on any path from each instruction
+	bool has_loop;
+	const char *why;           // reason for NO_BOUND
+};
+
+struct hint {
+	char func[NAME_SIZE];
+	char callee[NAME_SIZE];
+};
+
+static struct insn insns[MAX_INSNS];
+static uint32_t insn_count = 0;
+static struct func funcs[MAX_FUNCS];
+static uint32_t func_count = 0;
+static struct hint hints[MAX_HINTS];
+static uint32_t hint_count = 0;
+
+static bool analyze(struct func *f);
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "usage: %s [-s BYTES] [-c CYCLES] [-r FUNC]... [-i FUNC=CALLEE]...\n"
+	        "       %*s [-l FUNC=N]... DISASSEMBLY [SU_FILE]...\n"
+	        "  -s BYTES        stack budget for main plus one interrupt\n"
+	        "  -c CYCLES       cycle budget for every root\n"
+	        "  -r FUNC         check FUNC against the cycle budget (default:\n"
+	        "                  all interrupt handlers)\n"
+	        "  -i FUNC=CALLEE  the indirect calls in FUNC may call CALLEE\n"
+	        "  -l FUNC=N       the loops in FUNC go back at most N times\n",
+	        argv0, (int) strlen(argv0), "");
+	exit(2);
+}
+
+
+static struct func *find_func(const char *name)
+{
+	uint32_t i;
+
+	for (i = 0; i < func_count; i++) {
+		if (strcmp(funcs[i].name, name) == 0) return &funcs[i];
+	}
+	return NULL;
+}
+
+
+// the instruction at `addr`, or -1
+static int32_t find_insn(const uint32_t addr)
+{
+	uint32_t lo = 0, hi = insn_count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (insns[mid].addr < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo < insn_count && insns[lo].addr == addr) ? (int32_t) lo : -1;
+}
+
+
+// the function that instruction `i` belongs to
+static struct func *func_of(const uint32_t i)
+{
+	uint32_t f;
+
+	for (f = 0; f < func_count; f++) {
+		if (i >= funcs[f].first && i < funcs[f].first + funcs[f].count) {
+			return &funcs[f];
+		}
+	}
+	return NULL;
+}
+
+
+static bool op_is(const struct insn *in, const char *op)
+{
+	return strcmp(in->op, op) == 0;
+}
+
+
+// an interrupt handler, except the one for unused vectors
+static bool is_handler(const struct func *f)
+{
+	return strncmp(f->name, "__vector_", 9) == 0 &&
+	       strcmp(f->name, "__vector_default") != 0;
+}
+
+
+static bool is_skip(const struct insn *in)
+{
+	return op_is(in, "cpse") || op_is(in, "sbrc") || op_is(in, "sbrs") ||
+	       op_is(in, "sbic") || op_is(in, "sbis");
+}
+
+
+static bool is_branch(const struct insn *in)
+{
+	return in->op[0] == 'b' && in->op[1] == 'r';
+}
+
+
+// worst-case cycles of an instruction on the classic AVR core (16-bit PC)
+static uint32_t insn_cycles(const struct insn *in)
+{
+	static const char *TWO[] = {
+		"ld", "ldd", "st", "std", "lds", "sts", "push", "pop", "adiw",
+		"sbiw", "mul", "muls", "mulsu", "fmul", "fmuls", "fmulsu", "cbi",
+		"sbi", "rjmp", "ijmp", "eijmp", NULL
+	};
+	uint8_t i;
+
+	if (op_is(in, "call") || op_is(in, "ret") || op_is(in, "reti") ||
+	    op_is(in, "eicall")) {
+		return 4;
+	}
+	if (op_is(in, "rcall") || op_is(in, "icall") || op_is(in, "jmp") ||
+	    op_is(in, "lpm") || op_is(in, "elpm") || is_skip(in)) {
+		return 3;
+	}
+	if (is_branch(in)) return 2;
+	for (i = 0; TWO[i] != NULL; i++) {
+		if (op_is(in, TWO[i])) return 2;
+	}
+	return 1;
+}
+
+
+static uint32_t add(const uint32_t a, const uint32_t b)
+{
+	return (a == NO_BOUND || b == NO_BOUND) ? NO_BOUND : a + b;
+}
+
+
+static uint32_t max(const uint32_t a, const uint32_t b)
+{
+	return (a > b) ? a : b;
+}
+
+
+static void no_bound(struct func *f, const char *why)
+{
+	if (f->why == NULL) f->why = why;
+}
+
+
+/* PARSING */
+
+static void read_disassembly(const char *filename)
+{
+	char line[256], name[NAME_SIZE], *p, *end;
+	unsigned long addr;
+	struct insn *in;
+	FILE *file;
+	uint8_t bytes;
+
+	if ((file = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		exit(2);
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		// "00000094 <__vector_4>:" starts a function
+		if (sscanf(line, "%lx <%63[^>]>:", &addr, name) == 2) {
+			if (func_count == MAX_FUNCS) {
+				fprintf(stderr, "avrwcet: too many functions\n");
+				exit(2);
+			}
+			strcpy(funcs[func_count].name, name);
+			funcs[func_count].first = insn_count;
+			funcs[func_count].su = -1;
+			funcs[func_count].loop_bound = -1;
+			func_count++;
+			continue;
+		}
+
+		// "  a0:\t0e 94 4a 00 \tcall\t0x94\t; 0x94 <foo>" is an instruction
+		addr = strtoul(line, &end, 16);
+		if (end == line || *end != ':' || func_count == 0) continue;
+		p = end + 1;
+		bytes = 0;
+		while (*p == ' ' || *p == '\t' ||
+		       (isxdigit((unsigned char) p[0]) &&
+		        isxdigit((unsigned char) p[1]) &&
+		        (p[2] == ' ' || p[2] == '\t'))) {
+			if (*p == ' ' || *p == '\t') {
+				p++;
+			} else {
+				bytes++;
+				p += 2;
+			}
+		}
+		if (bytes == 0 || !isalpha((unsigned char) *p)) continue;
+		if (insn_count == MAX_INSNS) {
+			fprintf(stderr, "avrwcet: too many instructions\n");
+			exit(2);
+		}
+		in = &insns[insn_count++];
+		in->addr = addr;
+		in->size = bytes;
+		sscanf(p, "%7s", in->op);
+		// the target of a jump, branch or call is in the comment
+		if ((p = strstr(p, "; 0x")) != NULL) {
+			in->has_target = true;
+			in->target = strtoul(p + 2, NULL, 16);
+		}
+		funcs[func_count - 1].count++;
+	}
+	fclose(file);
+}
+
+
+// lines like "main.c:123:13:update_lights\t24\tstatic"
+static void read_stack_usage(const char *filename)
+{
+	char line[256], *name, *tab;
+	struct func *f;
+	FILE *file;
+
+	if ((file = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		exit(2);
+	}
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if ((tab = strchr(line, '\t')) == NULL) continue;
+		*tab = '\0';
+		name = strrchr(line, ':');
+		name = (name != NULL) ? name + 1 : line;
+		if ((f = find_func(name)) != NULL) f->su = atoi(tab + 1);
+	}
+	fclose(file);
+}
+
+
+static void add_hint(const char *arg, bool loop)
+{
+	const char *eq = strchr(arg, '=');
+	struct func *f;
+	char name[NAME_SIZE];
+
+	if (eq == NULL || eq - arg >= NAME_SIZE) {
+		fprintf(stderr, "avrwcet: bad hint: %s\n", arg);
+		exit(2);
+	}
+	memcpy(name, arg, eq - arg);
+	name[eq - arg] = '\0';
+	if (loop) {
+		if ((f = find_func(name)) == NULL) {
+			fprintf(stderr, "avrwcet: warning: no function %s\n", name);
+			return;
+		}
+		f->loop_bound = atoi(eq + 1);
+	} else if (hint_count < MAX_HINTS) {
+		strcpy(hints[hint_count].func, name);
+		snprintf(hints[hint_count].callee, NAME_SIZE, "%s", eq + 1);
+		hint_count++;
+	}
+}
+
+
+/* STACK DEPTH */
+
+static uint32_t depth_of(struct func *f);
+
+
+// the deepest stack below an indirect call in `f`
+static uint32_t indirect_depth(struct func *f)
+{
+	struct func *callee;
+	uint32_t i, depth = 0;
+	bool resolved = false;
+
+	for (i = 0; i < hint_count; i++) {
+		if (strcmp(hints[i].func, f->name) != 0) continue;
+		if ((callee = find_func(hints[i].callee)) == NULL) continue;
+		depth = max(depth, depth_of(callee));
+		resolved = true;
+	}
+	if (!resolved) {
+		no_bound(f, "indirect call without a hint");
+		return NO_BOUND;
+	}
+	return depth;
+}
+
+
+static uint32_t depth_of(struct func *f)
+{
+	const struct insn *in;
+	struct func *callee;
+	uint32_t i, own = 2, deepest = 0; // the return address
+	int32_t target;
+
+	if (f->stack_state == 2) return f->depth;
+	if (f->stack_state == 1) {
+		no_bound(f, "recursion");
+		return NO_BOUND;
+	}
+	f->stack_state = 1;
+
+	for (i = f->first; i < f->first + f->count; i++) {
+		in = &insns[i];
+		if (op_is(in, "push")) own++;
+		if (op_is(in, "icall") || op_is(in, "eicall")) {
+			deepest = max(deepest, indirect_depth(f));
+		}
+		if (!in->has_target || op_is(in, "ret")) continue;
+		if (!op_is(in, "call") && !op_is(in, "rcall") &&
+		    !op_is(in, "jmp") && !op_is(in, "rjmp")) {
+			continue;
+		}
+		// "rcall .+0" only makes room on the stack
+		if (op_is(in, "rcall") && in->target == in->addr + in->size) {
+			own += 2;
+			continue;
+		}
+		target = find_insn(in->target);
+		if (target < 0) continue;
+		callee = func_of(target);
+		if (callee == NULL || callee == f) continue;
+		// the .su file already counts what the call prologue pushes
+		if (f->su >= 0 && strncmp(callee->name, "__prologue_saves__", 18) == 0) {
+			continue;
+		}
+		if (f->su >= 0 && strncmp(callee->name, "__epilogue_restores__", 21) == 0) {
+			continue;
+		}
+		deepest = max(deepest, depth_of(callee));
+	}
+	f->stack = (f->su >= 0) ? (uint32_t) f->su : own;
+	f->depth = add(f->stack, deepest);
+	if (f->depth == NO_BOUND) no_bound(f, "no bound on a callee");
+	f->stack_state = 2;
+	return f->depth;
+}
+
+
+/* CYCLES */
+
+// the bound on the paths from instruction `i` of `f` onwards
+static uint32_t path_from(struct func *f, const uint32_t i)
+{
+	uint32_t bound;
+
+	if (!analyze(f)) return NO_BOUND;
+	bound = f->path[i - f->first];
+	if (!f->has_loop || bound == NO_BOUND) return bound;
+	if (f->loop_bound < 0) return NO_BOUND;
+	return bound * (uint32_t) (f->loop_bound + 1);
+}
+
+
+// the cycles of an indirect call in `f`
+static uint32_t indirect_cycles(struct func *f)
+{
+	struct func *callee;
+	uint32_t i, cycles = 0;
+	bool resolved = false;
+
+	for (i = 0; i < hint_count; i++) {
+		if (strcmp(hints[i].func, f->name) != 0) continue;
+		if ((callee = find_func(hints[i].callee)) == NULL) continue;
+		cycles = max(cycles, path_from(callee, callee->first));
+		resolved = true;
+	}
+	if (!resolved) {
+		no_bound(f, "indirect call without a hint");
+		return NO_BOUND;
+	}
+	return cycles;
+}
+
+
+// the longest path from instruction `i` onwards, with the loops cut open;
+// later instructions are done already
+static uint32_t longest_from(struct func *f, const uint32_t i)
+{
+	const struct insn *in = &insns[i];
+	const uint32_t last = f->first + f->count - 1;
+	uint32_t cycles = insn_cycles(in), next = 0, j;
+	struct func *callee = NULL;
+	int32_t target = -1;
+	bool tail = false;
+
+	if (in->has_target) {
+		target = find_insn(in->target);
+		if (target >= 0) callee = func_of(target);
+	}
+
+	if (op_is(in, "ret") || op_is(in, "reti")) return cycles;
+	if (op_is(in, "ijmp") || op_is(in, "eijmp")) {
+		// only the library's jump tables and call prologues get here
+		return cycles;
+	}
+	if (op_is(in, "icall") || op_is(in, "eicall")) {
+		cycles = add(cycles, indirect_cycles(f));
+	}
+
+	if (op_is(in, "call") || op_is(in, "rcall") ||
+	    op_is(in, "jmp") || op_is(in, "rjmp")) {
+		if (target < 0) {
+			no_bound(f, "jump to an unknown address");
+			return NO_BOUND;
+		}
+		tail = op_is(in, "jmp") || op_is(in, "rjmp");
+		if (callee != f && strncmp(callee->name, "__tablejump", 11) == 0) {
+			// a switch: any case further on in this function
+			cycles = add(cycles, path_from(callee, target));
+			for (j = i + 1; j <= last; j++) {
+				next = max(next, f->path[j - f->first]);
+			}
+			return add(cycles, next);
+		} else if (callee != f) {
+			cycles = add(cycles, path_from(callee, target));
+			if (cycles == NO_BOUND) no_bound(f, "no bound on a callee");
+			// the call prologue jumps back to us
+			if (!tail || strncmp(callee->name, "__prologue_saves__", 18) == 0) {
+				tail = false;
+			}
+			if (tail) return cycles;
+		} else if (tail) {
+			if ((uint32_t) target <= i) {
+				f->has_loop = true;
+				return cycles;
+			}
+			return add(cycles, f->path[target - f->first]);
+		}
+		// a call, or "rcall .+0", continues with the next instruction
+	} else if (is_branch(in) && in->has_target) {
+		if (target < 0 || callee != f) {
+			no_bound(f, "branch out of the function");
+			return NO_BOUND;
+		}
+		if ((uint32_t) target <= i) {
+			f->has_loop = true;
+		} else {
+			next = f->path[target - f->first];
+		}
+	} else if (is_skip(in) && i + 2 <= last) {
+		next = f->path[i + 2 - f->first];
+	}
+
+	// and fall through
+	if (i < last) {
+		next = max(next, f->path[i + 1 - f->first]);
+	} else if (f + 1 < funcs + func_count) {
+		// into the next function
+		next = max(next, path_from(f + 1, (f + 1)->first));
+	}
+	return add(cycles, next);
+}
+
+
+// fill in the longest paths through `f`, or tell that it is busy with it
+// (recursion)
+static bool analyze(struct func *f)
+{
+	uint32_t k;
+
+	if (f->cycle_state == 1) {
+		no_bound(f, "recursion");
+		return false;
+	}
+	if (f->cycle_state == 0) {
+		f->cycle_state = 1;
+		f->path = calloc(f->count + 1, sizeof(*f->path));
+		for (k = f->count; k-- > 0;) {
+			f->path[k] = longest_from(f, f->first + k);
+		}
+		if (f->has_loop && f->loop_bound < 0) no_bound(f, "loop without a hint");
+		f->cycle_state = 2;
+	}
+	return true;
+}
+
+
+/* REPORT */
+
+static void print_bound(const uint32_t value, const int width)
+{
+	if (value == NO_BOUND) {
+		printf(" %*s", width, "-");
+	} else {
+		printf(" %*lu", width, (unsigned long) value);
+	}
+}
+
+
+static bool is_root(const struct func *f, const char **roots,
+                    const uint32_t root_count)
+{
+	uint32_t i;
+
+	if (root_count == 0) return is_handler(f);
+	for (i = 0; i < root_count; i++) {
+		if (strcmp(roots[i], f->name) == 0) return true;
+	}
+	return false;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *roots[MAX_ROOTS], *hint_args[2 * MAX_HINTS];
+	uint32_t root_count = 0, hint_arg_count = 0, i;
+	uint32_t main_depth, isr_depth = 0, cycles;
+	long stack_budget = -1, cycle_budget = -1;
+	struct func *f;
+	bool ok = true;
+	int a;
+
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (a + 1 == argc) usage(argv[0]);
+		if (strcmp(argv[a], "-s") == 0) {
+			stack_budget = atol(argv[++a]);
+		} else if (strcmp(argv[a], "-c") == 0) {
+			cycle_budget = atol(argv[++a]);
+		} else if (strcmp(argv[a], "-r") == 0 && root_count < MAX_ROOTS) {
+			roots[root_count++] = argv[++a];
+		} else if ((strcmp(argv[a], "-i") == 0 || strcmp(argv[a], "-l") == 0) &&
+		           hint_arg_count < 2 * MAX_HINTS) {
+			// added once the functions are known
+			hint_args[hint_arg_count++] = argv[a];
+			hint_args[hint_arg_count++] = argv[++a];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (a == argc) usage(argv[0]);
+	read_disassembly(argv[a]);
+	for (a++; a < argc; a++) read_stack_usage(argv[a]);
+	for (i = 0; i < hint_arg_count; i += 2) {
+		add_hint(hint_args[i + 1], hint_args[i][1] == 'l');
+	}
+
+	printf("%-32s %6s %6s %9s\n", "function", "frame", "depth", "cycles");
+	for (i = 0; i < func_count; i++) {
+		f = &funcs[i];
+		depth_of(f);
+		cycles = path_from(f, f->first);
+		printf("%-32s", f->name);
+		print_bound(f->stack, 6);
+		print_bound(f->depth, 6);
+		print_bound(cycles, 9);
+		if (f->why != NULL) printf("  (%s)", f->why);
+		printf("\n");
+	}
+	printf("\n");
+
+	// the stack: main with the deepest interrupt handler on top of it
+	if ((f = find_func("main")) == NULL) {
+		fprintf(stderr, "avrwcet: no main\n");
+		return 2;
+	}
+	main_depth = f->depth;
+	for (i = 0; i < func_count; i++) {
+		if (is_handler(&funcs[i])) isr_depth = max(isr_depth, funcs[i].depth);
+	}
+	if (main_depth == NO_BOUND || isr_depth == NO_BOUND) {
+		printf("stack: no bound\n");
+		ok = false;
+	} else {
+		printf("stack: %lu + %lu = %lu bytes", (unsigned long) main_depth,
+		       (unsigned long) isr_depth,
+		       (unsigned long) (main_depth + isr_depth));
+		if (stack_budget >= 0) {
+			printf(" (budget %ld)", stack_budget);
+			if (main_depth + isr_depth > (uint32_t) stack_budget) {
+				printf(" EXCEEDED");
+				ok = false;
+			}
+		}
+		printf("\n");
+	}
+
+	for (i = 0; i < func_count; i++) {
+		f = &funcs[i];
+		if (!is_root(f, roots, root_count)) continue;
+		cycles = path_from(f, f->first);
+		if (is_handler(f)) cycles = add(cycles, ISR_ENTRY_CYCLES);
+		if (cycles == NO_BOUND) {
+			printf("cycles: %s no bound (%s)\n", f->name,
+			       f->why != NULL ? f->why : "no bound on a callee");
+			ok = false;
+			continue;
+		}
+		printf("cycles: %s %lu", f->name, (unsigned long) cycles);
+		if (cycle_budget >= 0) {
+			printf(" (budget %ld)", cycle_budget);
+			if (cycles > (uint32_t) cycle_budget) {
+				printf(" EXCEEDED");
+				ok = false;
+			}
+		}
+		printf("\n");
+	}
+	for (i = 0; i < root_count; i++) {
+		if (find_func(roots[i]) == NULL) {
+			printf("cycles: %s not found (inlined?)\n", roots[i]);
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
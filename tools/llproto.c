@@ -0,0 +1,330 @@
+/*
+ * Build command frames for the binary protocol and decode the frames that
+ * come back (see proto.h)
+ *
+ *     llproto query 1 > /dev/ttyAMA0
+ *     llproto settime 255 > /dev/ttyAMA0
+ *     llproto schedule 1 schedule.bin > /dev/ttyAMA0
+ *     llproto trace 1 > /dev/ttyAMA0
+ *     llproto decode < /dev/ttyAMA0
+ *
+ * The text log that is sent between the frames is skipped while decoding. A
+ * trace (see trace.h) is printed as a timeline once all its records are in.
+ */
+
+#include "proto.h"
+#include "trace.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *K_NAMES[] = {"off", "on", "flashing"};
+static const char *CONTROL_NAMES[] = {
+	"off", "hour", "minute", "second", "day", "month", "year"
+};
+static const char *BUTTON_NAMES[] = {"idle", "pressed", "held", "released"};
+
+// the trace that is coming in, from a PROTO_TRACE_HEAD frame on
+static struct {
+	bool active;
+	uint8_t addr, seq;
+	uint8_t count;
+	time_t time;
+	uint16_t now;
+	struct trace_record records[256];
+} incoming;
+
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+	        "usage: %s query ADDR\n"
+	        "       %s settime ADDR [UNIX_TIME]\n"
+	        "       %s force ADDR LIGHTS SECONDS\n"
+	        "       %s period ADDR SECONDS\n"
+	        "       %s schedule ADDR FILE\n"
+	        "       %s trace ADDR\n"
+	        "       %s decode\n"
+	        "ADDR %u addresses all indicators, which will not reply\n"
+	        "FILE is a schedule blob from `mkschedule -b`\n",
+	        argv0, argv0, argv0, argv0, argv0, argv0, argv0, PROTO_BROADCAST);
+	exit(2);
+}
+
+
+static unsigned long number(const char *s)
+{
+	char *end;
+	const unsigned long value = strtoul(s, &end, 0);
+
+	if (*s == '\0' || *end != '\0') {
+		fprintf(stderr, "llproto: not a number: %s\n", s);
+		exit(2);
+	}
+	return value;
+}
+
+
+static void send(uint8_t addr, uint8_t type, const uint8_t *payload,
+                 uint8_t len)
+{
+	uint16_t crc = 0xffff;
+	uint8_t header[4];
+	uint8_t i;
+
+	header[0] = addr;
+	header[1] = (uint8_t) time(NULL);
+	header[2] = type;
+	header[3] = len;
+	putchar(PROTO_SYNC);
+	for (i = 0; i < 4; i++) {
+		crc = crc16_update(crc, header[i]);
+		putchar(header[i]);
+	}
+	for (i = 0; i < len; i++) {
+		crc = crc16_update(crc, payload[i]);
+		putchar(payload[i]);
+	}
+	putchar(crc & 0xff);
+	putchar(crc >> 8);
+}
+
+
+// send a schedule blob in as many PROTO_CMD_SCHEDULE frames as it takes
+static void send_schedule(uint8_t addr, const char *filename)
+{
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t offset = 0;
+	size_t n;
+	FILE *f;
+
+	if ((f = fopen(filename, "rb")) == NULL) {
+		perror(filename);
+		exit(1);
+	}
+	while ((n = fread(payload + 1, 1, PROTO_MAX_PAYLOAD - 1, f)) > 0) {
+		payload[0] = offset;
+		send(addr, PROTO_CMD_SCHEDULE, payload, n + 1);
+		offset += n;
+	}
+	fclose(f);
+}
+
+
+// print one trace record, which happened `before` seconds before the dump
+static void print_record(const struct trace_record *r, double before)
+{
+	const unsigned data = r->what & TRACE_DATA_MAX;
+	const double at = (double) incoming.time - before;
+	const time_t t = (time_t) floor(at);
+	char buf[32];
+
+	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", gmtime(&t));
+	printf("  %s.%03dZ %9.3f s  ", buf, (int) ((at - floor(at)) * 1000),
+	       before > 0 ? -before : 0.0);
+	switch (r->what >> 12) {
+		case TRACE_RESET:
+			printf("reset%s\n", data ? " by the watchdog" : "");
+			break;
+		case TRACE_INT0:
+			printf("int0 button %s\n", data ? "down" : "up");
+			break;
+		case TRACE_TIMER2_OVF:
+			printf("timer2_ovf x%u\n", data);
+			break;
+		case TRACE_BUTTON:
+			printf("button %s\n", data < 4 ? BUTTON_NAMES[data] : "?");
+			break;
+		case TRACE_K:
+			printf("k %s\n", data < 3 ? K_NAMES[data] : "?");
+			break;
+		case TRACE_CONTROL:
+			printf("control %s\n", data < 7 ? CONTROL_NAMES[data] : "?");
+			break;
+		case TRACE_LIGHTS:
+			printf("lights 0x%03x\n", data);
+			break;
+		case TRACE_JOURNAL:
+			printf("journal record %u\n", data);
+			break;
+		case TRACE_SCHEDULE:
+			printf("schedule offset %u\n", data);
+			break;
+		default:
+			printf("event=%u data=0x%03x\n", r->what >> 12, data);
+			break;
+	}
+}
+
+
+// print the whole trace, with the time of every record
+static void print_trace()
+{
+	static long at[256];
+	const struct trace_record *r = &incoming.records[0];
+	long end = r->time;
+	uint16_t delta;
+	unsigned i;
+
+	// unwrap the 16 bit times from the oldest record on: records are at most
+	// one Timer2 overflow apart, after the overflows in a TIMER2_OVF record
+	// (a time that goes back, like across a reset, counts as no time at all)
+	for (i = 0; i < incoming.count; i++) {
+		r = &incoming.records[i];
+		delta = r->time - (uint16_t) end;
+		at[i] = end + (delta < 0x8000 ? delta : 0);
+		end = at[i];
+		if (r->what >> 12 == TRACE_TIMER2_OVF) {
+			end += ((r->what & TRACE_DATA_MAX) - 1) * 256L;
+		}
+	}
+	// and the time of the dump comes after the last one
+	delta = incoming.now - (uint16_t) end;
+	end += delta < 0x8000 ? delta : 0;
+	for (i = 0; i < incoming.count; i++) {
+		print_record(&incoming.records[i], (double) (end - at[i]) / 512);
+	}
+}
+
+
+static void print_frame(const struct proto_frame *f)
+{
+	const uint8_t *p = f->payload;
+	time_t t;
+	char buf[32];
+	unsigned i;
+
+	printf("addr=%u seq=%u ", f->addr, f->seq);
+	if (f->type == PROTO_STATE && f->len == PROTO_STATE_LEN) {
+		t = proto_get_u32(p + PROTO_STATE_TIME);
+		strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+		printf("state time=%s lights=0x%03x k=%s control=%s "
+		       "tx_dropped=%u rx_errors=%u uptime=%lu\n",
+		       buf, proto_get_u16(p + PROTO_STATE_LIGHTS),
+		       p[PROTO_STATE_K] < 3 ? K_NAMES[p[PROTO_STATE_K]] : "?",
+		       p[PROTO_STATE_CONTROL] < 7 ?
+		           CONTROL_NAMES[p[PROTO_STATE_CONTROL]] : "?",
+		       proto_get_u16(p + PROTO_STATE_TX_DROPPED),
+		       proto_get_u16(p + PROTO_STATE_RX_ERRORS),
+		       (unsigned long) proto_get_u32(p + PROTO_STATE_UPTIME));
+	} else if (f->type == PROTO_ACK && f->len == 1) {
+		printf("ack status=%u\n", p[0]);
+	} else if (f->type == PROTO_TRACE_HEAD && f->len == PROTO_TRACE_HEAD_LEN) {
+		t = proto_get_u32(p + PROTO_TRACE_HEAD_TIME);
+		strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+		printf("trace time=%s records=%u%s\n", buf,
+		       p[PROTO_TRACE_HEAD_COUNT],
+		       p[PROTO_TRACE_HEAD_WATCHDOG] ? " after a watchdog reset" : "");
+		incoming.active = true;
+		incoming.addr = f->addr;
+		incoming.seq = f->seq;
+		incoming.count = p[PROTO_TRACE_HEAD_COUNT];
+		incoming.time = t;
+		incoming.now = proto_get_u16(p + PROTO_TRACE_HEAD_NOW);
+	} else if (f->type == PROTO_TRACE && f->len >= 1 && (f->len - 1) % 4 == 0) {
+		printf("trace records=%u-%u\n", p[0], p[0] + (f->len - 1) / 4 - 1);
+		if (!incoming.active || f->addr != incoming.addr || f->seq != incoming.seq) {
+			return;
+		}
+		for (i = 0; i < (f->len - 1) / 4; i++) {
+			incoming.records[(p[0] + i) & 0xff].what =
+				proto_get_u16(p + 1 + 4 * i);
+			incoming.records[(p[0] + i) & 0xff].time =
+				proto_get_u16(p + 3 + 4 * i);
+		}
+		if (p[0] + i >= incoming.count) {
+			print_trace();
+			incoming.active = false;
+		}
+	} else {
+		printf("type=0x%02x len=%u\n", f->type, f->len);
+	}
+}
+
+
+// decode all frames from stdin; a frame is recognized by its CRC
+static void decode()
+{
+	uint8_t buf[4 + PROTO_MAX_PAYLOAD + 2];
+	struct proto_frame f;
+	uint16_t crc;
+	size_t n = 0, i;
+	int c;
+
+	// `buf` holds the bytes after a candidate sync byte
+	while ((c = getchar()) != EOF) {
+		if (n == 0 && c != PROTO_SYNC) continue;
+		if (n == 0) {
+			n = 1;
+			continue;
+		}
+		buf[n++ - 1] = c;
+		if (n - 1 < 4 || (buf[3] <= PROTO_MAX_PAYLOAD &&
+		                  n - 1 < 4u + buf[3] + 2)) {
+			continue;
+		}
+		if (buf[3] <= PROTO_MAX_PAYLOAD) {
+			crc = 0xffff;
+			for (i = 0; i < 4u + buf[3]; i++) {
+				crc = crc16_update(crc, buf[i]);
+			}
+			if (crc == proto_get_u16(buf + 4 + buf[3])) {
+				f.addr = buf[0];
+				f.seq = buf[1];
+				f.type = buf[2];
+				f.len = buf[3];
+				memcpy(f.payload, buf + 4, f.len);
+				print_frame(&f);
+				fflush(stdout);
+				n = 0;
+				continue;
+			}
+		}
+		// no frame after all, look for the next sync byte in what we have
+		for (i = 0; i < n - 1 && buf[i] != PROTO_SYNC; i++) {}
+		if (i == n - 1) {
+			n = 0;
+		} else {
+			memmove(buf, buf + i + 1, n - 2 - i);
+			n -= i + 1;
+		}
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t addr;
+
+	if (argc == 2 && strcmp(argv[1], "decode") == 0) {
+		decode();
+		return 0;
+	}
+	if (argc < 3) usage(argv[0]);
+	addr = number(argv[2]);
+
+	if (strcmp(argv[1], "query") == 0 && argc == 3) {
+		send(addr, PROTO_CMD_QUERY, payload, 0);
+	} else if (strcmp(argv[1], "settime") == 0 && argc <= 4) {
+		proto_put_u32(payload, argc == 4 ? number(argv[3]) : time(NULL));
+		send(addr, PROTO_CMD_SET_TIME, payload, 4);
+	} else if (strcmp(argv[1], "force") == 0 && argc == 5) {
+		proto_put_u16(payload, number(argv[3]));
+		proto_put_u16(payload + 2, number(argv[4]));
+		send(addr, PROTO_CMD_FORCE, payload, 4);
+	} else if (strcmp(argv[1], "period") == 0 && argc == 4) {
+		proto_put_u16(payload, number(argv[3]));
+		send(addr, PROTO_CMD_PERIOD, payload, 2);
+	} else if (strcmp(argv[1], "schedule") == 0 && argc == 4) {
+		send_schedule(addr, argv[3]);
+	} else if (strcmp(argv[1], "trace") == 0 && argc == 3) {
+		send(addr, PROTO_CMD_TRACE, payload, 0);
+	} else {
+		usage(argv[0]);
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Compile a text calendar (see calendar.txt) into the table from calendar.h
+ *
+ *     mkcalendar calendar.txt > calendar_table.h
+ *
+ * The table covers every year from the first to the last one in the file.
+ */
+
+#include "calendar.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define MAX_YEARS 16
+#define MAX_RANGES 256
+
+// the days from `first_year`, `first_day` up to and including `last_year`,
+// `last_day` (days of the year from 0)
+struct range {
+	int class;
+	int first_year, first_day;
+	int last_year, last_day;
+};
+
+static const char *CLASS_NAMES[] = {"lecture", "weekend", "holiday", "exams"};
+
+static const char *filename;
+static unsigned lineno;
+
+static uint8_t table[MAX_YEARS][CALENDAR_YEAR_SIZE];
+static int first_year = 0, last_year = 0;
+
+
+static void fail(const char *msg, const char *word)
+{
+	fprintf(stderr, "%s:%u: %s: %s\n", filename, lineno, msg, word);
+	exit(1);
+}
+
+
+static bool is_leap(const int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+
+static int year_days(const int year)
+{
+	return 365 + is_leap(year);
+}
+
+
+// day of the week of January 1st of `year` (0 is Sunday)
+static int year_wday(const int year)
+{
+	const int y = year - 1;
+
+	return (1 + 365 * y + y / 4 - y / 100 + y / 400) % 7;
+}
+
+
+static int parse_class(const char *word)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (strcasecmp(word, CLASS_NAMES[i]) == 0) return i;
+	}
+	fail("unknown class", word);
+	return -1;
+}
+
+
+// "yyyy-mm-dd" into a year and a day of that year (from 0)
+static void parse_date(const char *word, int *year, int *yday)
+{
+	static const int MONTH_DAYS[] = {
+		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+	};
+	int m, d, i;
+	char extra;
+
+	if (sscanf(word, "%d-%d-%d%c", year, &m, &d, &extra) != 3 ||
+	    *year < 2000 || m < 1 || m > 12 || d < 1 ||
+	    d > MONTH_DAYS[m - 1] + (m == 2 && is_leap(*year))) {
+		fail("bad date", word);
+	}
+	*yday = d - 1;
+	for (i = 0; i < m - 1; i++) {
+		*yday += MONTH_DAYS[i] + (i == 1 && is_leap(*year));
+	}
+}
+
+
+static void set_class(const int year, const int yday, const int class)
+{
+	uint8_t *byte = &table[year - first_year][yday / 4];
+	const int shift = 2 * (yday % 4);
+
+	*byte = (*byte & ~(3 << shift)) | class << shift;
+}
+
+
+int main(int argc, char *argv[])
+{
+	static struct range ranges[MAX_RANGES];
+	char line[256], *words[4], *p;
+	struct range *r;
+	int count = 0, year, yday, wday, i, n;
+	FILE *f;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s CALENDAR\n", argv[0]);
+		return 2;
+	}
+	filename = argv[1];
+	if ((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		if ((p = strchr(line, '#')) != NULL) *p = '\0';
+		for (n = 0, p = strtok(line, " \t\r\n"); p != NULL && n < 4;
+		     p = strtok(NULL, " \t\r\n")) {
+			words[n++] = p;
+		}
+		if (n == 0) continue;
+		if (n != 2 && n != 3) fail("expected CLASS FIRST [LAST]", words[0]);
+		if (count == MAX_RANGES) fail("too many lines", words[0]);
+
+		r = &ranges[count++];
+		r->class = parse_class(words[0]);
+		parse_date(words[1], &r->first_year, &r->first_day);
+		parse_date(words[n - 1], &r->last_year, &r->last_day);
+		if (r->last_year < r->first_year ||
+		    (r->last_year == r->first_year && r->last_day < r->first_day)) {
+			fail("last day before the first", words[n - 1]);
+		}
+		if (first_year == 0 || r->first_year < first_year) {
+			first_year = r->first_year;
+		}
+		if (r->last_year > last_year) last_year = r->last_year;
+	}
+	fclose(f);
+	if (count > 0 && last_year - first_year >= MAX_YEARS) {
+		fail("too many years", "");
+	}
+
+	// by default Monday to Friday are lecture days
+	for (year = first_year; count > 0 && year <= last_year; year++) {
+		wday = year_wday(year);
+		for (yday = 0; yday < year_days(year); yday++) {
+			set_class(year, yday, (wday == 0 || wday == 6) ?
+			          CALENDAR_WEEKEND : CALENDAR_LECTURE);
+			wday = (wday + 1) % 7;
+		}
+	}
+
+	// then the lines in order, which only change weekdays
+	for (r = ranges; r < ranges + count; r++) {
+		year = r->first_year;
+		yday = r->first_day;
+		wday = (year_wday(year) + yday) % 7;
+		for (;;) {
+			if (wday != 0 && wday != 6) set_class(year, yday, r->class);
+			if (year == r->last_year && yday == r->last_day) break;
+			wday = (wday + 1) % 7;
+			if (++yday == year_days(year)) {
+				year++;
+				yday = 0;
+			}
+		}
+	}
+
+	printf("/* Generated by tools/mkcalendar from %s, do not edit */\n\n"
+	       "#ifndef CALENDAR_TABLE_H_\n"
+	       "#define CALENDAR_TABLE_H_\n\n"
+	       "#define CALENDAR_FIRST_YEAR %d\n"
+	       "#define CALENDAR_YEARS %d\n"
+	       "#define CALENDAR_TABLE { \\\n", filename, first_year,
+	       count > 0 ? last_year - first_year + 1 : 0);
+	for (year = first_year; count > 0 && year <= last_year; year++) {
+		printf("\t{ /* %d */ \\\n\t", year);
+		for (i = 0; i < CALENDAR_YEAR_SIZE; i++) {
+			printf("0x%02x,%s", table[year - first_year][i],
+			       i + 1 == CALENDAR_YEAR_SIZE ? " \\\n" :
+			       (i % 12 == 11) ? " \\\n\t" : " ");
+		}
+		printf("\t}, \\\n");
+	}
+	printf("}\n\n#endif /* CALENDAR_TABLE_H_ */\n");
+	return 0;
+}
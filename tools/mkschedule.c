@@ -0,0 +1,231 @@
+/*
+ * Compile a text schedule (see schedule.txt) into the bytecode from schedule.h
+ *
+ *     mkschedule schedule.txt > schedule_default.h
+ *     mkschedule -b schedule.txt > schedule.bin
+ *
+ * The first form writes the C initializer that the firmware is built with,
+ * the second the raw blob that `llproto schedule` uploads.
+ */
+
+#include "calendar.h"
+#include "crc16.h"
+#include "pins.h"
+#include "schedule.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define LIGHT_NAME(name, port, bit) #name,
+static const char *LIGHT_NAMES[] = {
+	LIGHT_PINS(LIGHT_NAME)
+};
+#undef LIGHT_NAME
+
+static const char *DAY_NAMES[] = {
+	"sun", "mon", "tue", "wed", "thu", "fri", "sat"
+};
+
+// in the order of enum calendar_class
+static const char *CLASS_NAMES[] = {"lecture", "weekend", "holiday", "exams"};
+
+static const char *filename;
+static unsigned lineno;
+
+
+static void fail(const char *msg, const char *word)
+{
+	fprintf(stderr, "%s:%u: %s: %s\n", filename, lineno, msg, word);
+	exit(1);
+}
+
+
+static int parse_light(const char *word)
+{
+	int i;
+
+	for (i = 0; i < LIGHT_COUNT; i++) {
+		if (strcasecmp(word, LIGHT_NAMES[i]) == 0) return i;
+	}
+	fail("unknown light", word);
+	return -1;
+}
+
+
+static int parse_mode(const char *word)
+{
+	if (strcasecmp(word, "steady") == 0) return SCHEDULE_OP_STEADY;
+	if (strcasecmp(word, "flashing") == 0) return SCHEDULE_OP_FLASHING;
+	// dim:N, with N from 0 (off) to SCHEDULE_LEVEL_FULL
+	if (strncasecmp(word, "dim:", 4) == 0 && word[4] >= '0' &&
+	    word[4] <= '0' + SCHEDULE_LEVEL_FULL && word[5] == '\0') {
+		return SCHEDULE_OP_DIM | (word[4] - '0');
+	}
+	fail("unknown mode", word);
+	return -1;
+}
+
+
+static int parse_day(const char *word, size_t len)
+{
+	int i;
+
+	for (i = 0; i < 7; i++) {
+		if (len == 3 && strncasecmp(word, DAY_NAMES[i], 3) == 0) return i;
+	}
+	fail("unknown day", word);
+	return -1;
+}
+
+
+// the class of day (see calendar.h) named by the `len` bytes at `word`, or -1
+static int parse_class(const char *word, size_t len)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (strlen(CLASS_NAMES[i]) == len &&
+		    strncasecmp(word, CLASS_NAMES[i], len) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+// "daily", a list of days and day ranges like "mon-fri,sun", or a list of
+// classes of days like "lecture,exams"
+static unsigned parse_days(const char *word)
+{
+	const char *p = word, *dash, *end;
+	unsigned days = 0;
+	int first, last;
+
+	if (strcasecmp(word, "daily") == 0) return 0x7f;
+	if (parse_class(word, strcspn(word, ",")) >= 0) {
+		days = SCHEDULE_DAYS_CLASS;
+		while (*p != '\0') {
+			end = p + strcspn(p, ",");
+			if ((first = parse_class(p, end - p)) < 0) {
+				fail("unknown class of days", word);
+			}
+			days |= 1u << first;
+			p = (*end == ',') ? end + 1 : end;
+		}
+		return days;
+	}
+	while (*p != '\0') {
+		end = p + strcspn(p, ",");
+		dash = memchr(p, '-', end - p);
+		first = parse_day(p, (dash != NULL ? dash : end) - p);
+		last = (dash != NULL) ? parse_day(dash + 1, end - dash - 1) : first;
+		// ranges may wrap around the week, like fri-mon
+		for (;;) {
+			days |= 1u << first;
+			if (first == last) break;
+			first = (first + 1) % 7;
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return days;
+}
+
+
+// "hh:mm" into minutes since midnight, or "sunrise" or "sunset" with an
+// optional offset in minutes like "sunset+30" into a time relative to the sun
+static unsigned parse_time(const char *word)
+{
+	unsigned h, m, base;
+	int offset = 0;
+	size_t len;
+	char extra;
+
+	if (strncasecmp(word, "sunrise", 7) == 0 ||
+	    strncasecmp(word, "sunset", 6) == 0) {
+		base = (tolower((unsigned char) word[3]) == 'r') ? SCHEDULE_SUNRISE :
+		                                                    SCHEDULE_SUNSET;
+		len = (base == SCHEDULE_SUNRISE) ? 7 : 6;
+		if (word[len] != '\0' &&
+		    ((word[len] != '+' && word[len] != '-') ||
+		     sscanf(word + len, "%d%c", &offset, &extra) != 1 ||
+		     offset <= -SCHEDULE_SUN_BIAS || offset >= SCHEDULE_SUN_BIAS)) {
+			fail("bad time", word);
+		}
+		return base | (offset + SCHEDULE_SUN_BIAS);
+	}
+	if (sscanf(word, "%u:%u%c", &h, &m, &extra) != 2 || h > 23 || m > 59) {
+		fail("bad time", word);
+	}
+	return 60 * h + m;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint8_t blob[SCHEDULE_SIZE];
+	char line[256], *words[6], *p;
+	bool binary = false;
+	unsigned len = 0, start, end, i, n;
+	uint16_t crc = 0xffff;
+	FILE *f;
+
+	if (argc == 3 && strcmp(argv[1], "-b") == 0) binary = true;
+	if (argc != 2 + binary) {
+		fprintf(stderr, "usage: %s [-b] SCHEDULE\n", argv[0]);
+		return 2;
+	}
+	filename = argv[1 + binary];
+	if ((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		if ((p = strchr(line, '#')) != NULL) *p = '\0';
+		for (n = 0, p = strtok(line, " \t\r\n"); p != NULL && n < 6;
+		     p = strtok(NULL, " \t\r\n")) {
+			words[n++] = p;
+		}
+		if (n == 0) continue;
+		if (n != 5) fail("expected LIGHT MODE DAYS START END", words[0]);
+		if (len + SCHEDULE_INSN_SIZE > SCHEDULE_SIZE - 3) {
+			fail("schedule too long", words[0]);
+		}
+
+		start = parse_time(words[3]);
+		end = parse_time(words[4]);
+		blob[1 + len++] = parse_mode(words[1]) << 4 | parse_light(words[0]);
+		blob[1 + len++] = parse_days(words[2]);
+		blob[1 + len++] = start & 0xff;
+		blob[1 + len++] = start >> 8;
+		blob[1 + len++] = end & 0xff;
+		blob[1 + len++] = end >> 8;
+	}
+	fclose(f);
+
+	blob[0] = len;
+	for (i = 0; i <= len; i++) crc = crc16_update(crc, blob[i]);
+	blob[len + 1] = crc & 0xff;
+	blob[len + 2] = crc >> 8;
+
+	if (binary) {
+		fwrite(blob, 1, len + 3, stdout);
+		return 0;
+	}
+	printf("/* Generated by tools/mkschedule from %s, do not edit */\n\n"
+	       "#ifndef SCHEDULE_DEFAULT_H_\n"
+	       "#define SCHEDULE_DEFAULT_H_\n\n"
+	       "#define SCHEDULE_DEFAULT_LEN %u\n"
+	       "#define SCHEDULE_DEFAULT { \\\n\t", filename, len + 3);
+	for (i = 0; i < len + 3; i++) {
+		printf("0x%02x,%s", blob[i],
+		       i + 1 == len + 3 ? " \\\n" :
+		       (i % SCHEDULE_INSN_SIZE == 0) ? " \\\n\t" : " ");
+	}
+	printf("}\n\n#endif /* SCHEDULE_DEFAULT_H_ */\n");
+	return 0;
+}
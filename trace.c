@@ -0,0 +1,56 @@
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include <string.h>
+
+#define TRACE_MAGIC 0x7ace
+
+// left alone by the C runtime, so it survives a reset (but not a power cycle)
+struct trace_ring TRACE NOINIT;
+
+
+void trace_init(bool watchdog)
+{
+	// after a power cycle the RAM holds noise
+	if (TRACE.magic != TRACE_MAGIC || TRACE.head >= TRACE_RECORDS ||
+	    TRACE.count > TRACE_RECORDS) {
+		memset(&TRACE, 0, sizeof(TRACE));
+		TRACE.magic = TRACE_MAGIC;
+	}
+	// the reset may have come in the middle of a dump
+	TRACE.held = false;
+	trace(TRACE_RESET, watchdog);
+}
+
+
+uint8_t trace_hold(void)
+{
+	const bool irq = hal_irq_enabled();
+	uint8_t count;
+
+	hal_irq_disable();
+	TRACE.held = true;
+	count = TRACE.count;
+	if (irq) hal_irq_enable();
+	return count;
+}
+
+
+void trace_release(void)
+{
+	TRACE.held = false;
+}
+
+
+void trace_get(uint8_t i, struct trace_record *record)
+{
+	const bool irq = hal_irq_enabled();
+
+	hal_irq_disable();
+	*record = TRACE.records[(TRACE.head - TRACE.count + i) &
+	                        (TRACE_RECORDS - 1)];
+	if (irq) hal_irq_enable();
+}
+
+#endif /* ENABLE_TRACE */
@@ -0,0 +1,139 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*
+ * Event trace (build with -DENABLE_TRACE)
+ *
+ * A ring of the last TRACE_RECORDS events (a power of two) in RAM that the C
+ * runtime does not clear, so after a watchdog reset it still shows what led
+ * up to it. Every record is four bytes:
+ *
+ *     event << 12 | data (u16), time (u16)
+ *
+ * where `time` counts Timer2 counts (1/512 s) and wraps around every 128 s:
+ * its high byte counts Timer2 overflows and its low byte is the Timer2
+ * counter. Consecutive Timer2 overflows share one TRACE_TIMER2_OVF record,
+ * which carries the time of the first one and counts them, so no two
+ * records are more than one overflow apart once the count is taken into
+ * account. An event that comes in at the same time as an overflow may be
+ * recorded before it, half a second early. After a reset the overflow count
+ * goes on where it was, but the time spent in the reset and in init() is lost.
+ *
+ * Recording an event takes a few dozen cycles with interrupts disabled. The
+ * main loop sends the ring on PROTO_CMD_TRACE and after a watchdog reset,
+ * and `tools/llproto decode` turns it into a timeline.
+ *
+ * Without ENABLE_TRACE all of this compiles to nothing.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 16
+#endif /* TRACE_RECORDS */
+
+#if TRACE_RECORDS > 128 || (TRACE_RECORDS & (TRACE_RECORDS - 1)) != 0
+#error "TRACE_RECORDS must be a power of two, at most 128"
+#endif
+
+// what happened, and the `data` that goes with it
+enum trace_event {
+	TRACE_RESET,       // 1 after a watchdog reset, 0 after any other reset
+	TRACE_INT0,        // 1 if the CONTROL button is down
+	TRACE_TIMER2_OVF,  // the number of overflows in a row
+	TRACE_BUTTON,      // the new state of the gestures in button.c
+	TRACE_K,           // the new K_STATE
+	TRACE_CONTROL,     // the new CONTROL_STATE
+	TRACE_LIGHTS,      // the new light state
+	TRACE_JOURNAL,     // a journal record starts to be written to this slot
+	TRACE_SCHEDULE     // schedule bytes are written from this offset
+};
+
+#define TRACE_DATA_MAX 0x0fff
+
+struct trace_record {
+	uint16_t what;
+	uint16_t time;
+};
+
+#ifdef ENABLE_TRACE
+
+#include "hal.h"
+
+struct trace_ring {
+	uint16_t magic;  // TRACE_MAGIC if the ring survived the reset
+	uint8_t head;    // the record that is written next
+	uint8_t count;   // the number of records, at most TRACE_RECORDS
+	uint8_t ticks;   // Timer2 overflows
+	bool held;       // see trace_hold
+	struct trace_record records[TRACE_RECORDS];
+};
+
+extern struct trace_ring TRACE;
+
+// keep the ring if it survived the reset, and record the reset
+void trace_init(bool watchdog);
+
+// keep the records where they are while they are sent, and return their
+// count; the events until trace_release are not recorded, but the time goes
+// on
+uint8_t trace_hold(void);
+void trace_release(void);
+
+// record `i` of them, the oldest being 0
+void trace_get(uint8_t i, struct trace_record *record);
+
+// the current time, in the same counts as the records
+static inline uint16_t trace_now(void)
+{
+	return (uint16_t) TRACE.ticks << 8 | hal_timer2_count();
+}
+
+
+// record `event` with `data` (at most TRACE_DATA_MAX)
+static inline void trace(const enum trace_event event, const uint16_t data)
+{
+	const bool irq = hal_irq_enabled();
+	struct trace_record *record;
+
+	hal_irq_disable();
+	if (TRACE.held) {
+		if (irq) hal_irq_enable();
+		return;
+	}
+	record = &TRACE.records[TRACE.head];
+	record->what = (uint16_t) event << 12 | data;
+	record->time = trace_now();
+	TRACE.head = (TRACE.head + 1) & (TRACE_RECORDS - 1);
+	if (TRACE.count < TRACE_RECORDS) TRACE.count++;
+	if (irq) hal_irq_enable();
+}
+
+
+// call from TIMER2_OVF_vect: count the overflow, in the last record if that
+// one counts overflows too
+static inline void trace_timer2_ovf(void)
+{
+	struct trace_record *last =
+		&TRACE.records[(TRACE.head - 1) & (TRACE_RECORDS - 1)];
+
+	TRACE.ticks++;
+	if (TRACE.held) return;
+	if (TRACE.count != 0 && last->what >> 12 == TRACE_TIMER2_OVF &&
+	    (last->what & TRACE_DATA_MAX) != TRACE_DATA_MAX) {
+		last->what++;
+	} else {
+		trace(TRACE_TIMER2_OVF, 1);
+	}
+}
+
+#else /* ENABLE_TRACE */
+
+static inline void trace_init(bool watchdog) {}
+static inline void trace(const enum trace_event event, const uint16_t data) {}
+static inline void trace_timer2_ovf(void) {}
+
+#endif /* ENABLE_TRACE */
+
+#endif /* TRACE_H_ */
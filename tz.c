@@ -0,0 +1,207 @@
+#include "tz.h"
+#include <stddef.h>
+
+static struct tz_rule rule;
+
+// the DST offset is `cache_dst` from `cache_from` up to `cache_until`
+static time_t cache_from = 1, cache_until = 0;
+static int cache_dst = 0;
+
+
+/* PARSING */
+
+static bool is_digit(const char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+
+// parse a zone name like "CET" or "<+03>"
+static const char *parse_name(const char *s)
+{
+	const char *begin = s;
+
+	if (*s == '<') {
+		while (*s != '\0' && *s != '>') s++;
+		return *s == '>' ? s + 1 : NULL;
+	}
+	while ((*s >= 'A' && *s <= 'Z') || (*s >= 'a' && *s <= 'z')) s++;
+	return (s - begin >= 3) ? s : NULL;
+}
+
+
+// parse "[+-]hh[:mm[:ss]]" into seconds
+static const char *parse_time(const char *s, int32_t *out)
+{
+	int32_t value = 0, part;
+	bool negative = false;
+	uint8_t i;
+
+	if (*s == '+' || *s == '-') {
+		negative = (*s == '-');
+		s++;
+	}
+	for (i = 0; i < 3; i++) {
+		if (!is_digit(*s)) return NULL;
+		part = 0;
+		while (is_digit(*s)) part = 10 * part + (*s++ - '0');
+		value += part * (i == 0 ? 3600 : i == 1 ? 60 : 1);
+		if (*s != ':') break;
+		s++;
+	}
+	*out = negative ? -value : value;
+	return s;
+}
+
+
+static const char *parse_number(const char *s, uint8_t *out,
+                                const uint8_t min, const uint8_t max)
+{
+	uint8_t value = 0;
+
+	if (!is_digit(*s)) return NULL;
+	while (is_digit(*s)) {
+		value = 10 * value + (*s++ - '0');
+		if (value > max) return NULL;
+	}
+	*out = value;
+	return value >= min ? s : NULL;
+}
+
+
+// parse ",Mm.w.d[/time]"
+static const char *parse_date(const char *s, struct tz_date *date)
+{
+	if (*s++ != ',' || *s++ != 'M') return NULL;
+	if ((s = parse_number(s, &date->month, 1, 12)) == NULL) return NULL;
+	if (*s++ != '.') return NULL;
+	if ((s = parse_number(s, &date->week, 1, 5)) == NULL) return NULL;
+	if (*s++ != '.') return NULL;
+	if ((s = parse_number(s, &date->wday, 0, 6)) == NULL) return NULL;
+
+	date->time = 2 * ONE_HOUR;
+	if (*s == '/') s = parse_time(s + 1, &date->time);
+	return s;
+}
+
+
+bool tz_parse(struct tz_rule *out, const char *str)
+{
+	const char *s;
+	int32_t offset;
+
+	// POSIX offsets count westwards, ours eastwards
+	if ((s = parse_name(str)) == NULL) return false;
+	if ((s = parse_time(s, &offset)) == NULL) return false;
+	out->std_offset = -offset;
+	out->has_dst = false;
+	if (*s == '\0') return true;
+
+	if ((s = parse_name(s)) == NULL) return false;
+	out->dst_offset = out->std_offset + ONE_HOUR;
+	if (*s != ',') {
+		if ((s = parse_time(s, &offset)) == NULL) return false;
+		out->dst_offset = -offset;
+	}
+	if ((s = parse_date(s, &out->start)) == NULL) return false;
+	if ((s = parse_date(s, &out->end)) == NULL) return false;
+	out->has_dst = true;
+	return *s == '\0';
+}
+
+
+/* DST TRANSITIONS */
+
+// days from 2000-01-01 up to the first day of `year`
+static int32_t days_before_year(const int16_t year)
+{
+	const int16_t y = year - 1;
+	return (int32_t) (year - 2000) * 365 + (y / 4 - y / 100 + y / 400) -
+	       (1999 / 4 - 1999 / 100 + 1999 / 400);
+}
+
+
+// UTC time of the transition on `date` in `year`, with UTC offset `offset`
+static time_t transition_time(const struct tz_date *date, const int16_t year,
+                              const int32_t offset)
+{
+	int32_t days = days_before_year(year);
+	uint8_t month, mday, wday, len;
+
+	for (month = 1; month < date->month; month++) {
+		days += month_length(year, month);
+	}
+
+	// 2000-01-01 was a Saturday
+	wday = (days + SATURDAY) % 7;
+	mday = 1 + (date->wday + 7 - wday) % 7 + 7 * (date->week - 1);
+	len = month_length(year, date->month);
+	while (mday > len) mday -= 7;
+
+	days += mday - 1;
+	return (time_t) (days * ONE_DAY + date->time - offset);
+}
+
+
+// fill the cache with the DST period around `timer`
+static void tz_update(const time_t timer)
+{
+	struct tm tm;
+	time_t start, end, first, last;
+	int16_t year;
+	bool dst;
+
+	gmtime_r(&timer, &tm);
+	year = 1900 + tm.tm_year;
+	start = transition_time(&rule.start, year, rule.std_offset);
+	end = transition_time(&rule.end, year, rule.dst_offset);
+
+	if (start < end) {
+		// northern hemisphere
+		dst = (start <= timer && timer < end);
+		first = start;
+		last = end;
+	} else {
+		// southern hemisphere
+		dst = (timer < end || start <= timer);
+		first = end;
+		last = start;
+	}
+
+	if (timer < first) {
+		cache_from = days_before_year(year) * ONE_DAY;
+		cache_until = first;
+	} else if (timer < last) {
+		cache_from = first;
+		cache_until = last;
+	} else {
+		cache_from = last;
+		cache_until = days_before_year(year + 1) * ONE_DAY;
+	}
+	cache_dst = dst ? rule.dst_offset - rule.std_offset : 0;
+}
+
+
+void tz_init(const struct tz_rule *new_rule)
+{
+	rule = *new_rule;
+	if (rule.has_dst) {
+		// invalidate the cache
+		cache_from = 1;
+		cache_until = 0;
+	} else {
+		cache_from = 0;
+		cache_until = (time_t) -1;
+	}
+	cache_dst = 0;
+}
+
+
+int tz_dst(const time_t *timer, int32_t *z)
+{
+	(void) z;
+	if (*timer < cache_from || *timer >= cache_until) {
+		tz_update(*timer);
+	}
+	return cache_dst;
+}
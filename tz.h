@@ -0,0 +1,45 @@
+#ifndef TZ_H_
+#define TZ_H_
+
+/*
+ * Time zone rules
+ *
+ * A rule is written like the POSIX TZ environment variable, for example
+ * "CET-1CEST,M3.5.0,M10.5.0/3" for the Netherlands. Only the "Mm.w.d" form of
+ * the DST start and end dates is supported.
+ *
+ * `tz_dst` is meant to be passed to avr-libc's `set_dst`. It computes the
+ * next DST transition once and caches it, so usually it only does two
+ * compares.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define TZ_RULE_MAX 32
+
+struct tz_date {
+	uint8_t month; // 1..12
+	uint8_t week;  // 1..5, 5 means the last week of the month
+	uint8_t wday;  // 0 is Sunday
+	int32_t time;  // local time of the transition, in seconds since midnight
+};
+
+struct tz_rule {
+	int32_t std_offset; // seconds east of UTC
+	int32_t dst_offset; // seconds east of UTC during DST
+	bool has_dst;
+	struct tz_date start, end;
+};
+
+// parse a POSIX TZ string, returns false if `str` is not valid
+bool tz_parse(struct tz_rule *rule, const char *str);
+
+// use `rule` for all following calls to `tz_dst`
+void tz_init(const struct tz_rule *rule);
+
+// DST offset at UTC time `timer` (avr-libc's set_dst callback)
+int tz_dst(const time_t *timer, int32_t *z);
+
+#endif /* TZ_H_ */
@@ -1,30 +1,64 @@
 #include "uart.h"
-#include <avr/io.h>
-#include <unistd.h>
+#include "hal.h"
+#include "profile.h"
+
+#define TX_MASK (UART_TX_BUFFER_SIZE - 1)
+
+#if (UART_TX_BUFFER_SIZE & TX_MASK) != 0 || UART_TX_BUFFER_SIZE > 256
+#error "UART_TX_BUFFER_SIZE must be a power of two, at most 256"
+#endif
+
+#define RX_MASK (UART_RX_BUFFER_SIZE - 1)
+
+#if (UART_RX_BUFFER_SIZE & RX_MASK) != 0 || UART_RX_BUFFER_SIZE > 256
+#error "UART_RX_BUFFER_SIZE must be a power of two, at most 256"
+#endif
+
+// the main loop writes at `tx_head`, the UDRE interrupt reads at `tx_tail`
+static volatile uint8_t tx_buf[UART_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0, tx_tail = 0;
+static uint16_t tx_dropped = 0;
+static enum uart_overflow tx_overflow = UART_BLOCK;
+
+// the RXC interrupt writes at `rx_head`, the main loop reads at `rx_tail`
+static volatile uint8_t rx_buf[UART_RX_BUFFER_SIZE];
+static volatile uint8_t rx_head = 0, rx_tail = 0;
+static volatile uint16_t rx_errors = 0;
 
 void UART_init()
 {
-	// Set double speed mode
-	UCSRA |= (1 << U2X);
-
-	// Set baud rate to 9600
-	UBRRH = 0;
-	UBRRL = 12;
+	hal_uart_init();
+}
 
-	// Enable transmissions
-	UCSRB = 1 << TXEN;
+void UART_set_overflow(enum uart_overflow policy)
+{
+	tx_overflow = policy;
+}
 
-	// Set frame format
-	UCSRC = (1<<URSEL)|(1<<USBS)|(3<<UCSZ0);
+// send the oldest byte in the buffer, bypassing the interrupt
+static void tx_poll()
+{
+	while (!hal_uart_ready()) {}
+	hal_uart_write(tx_buf[tx_tail]);
+	tx_tail = (tx_tail + 1) & TX_MASK;
 }
 
 void UART_transmit(uint8_t data)
 {
-	// Wait for empty transmit buffer
-	while ( !(UCSRA & (1<<UDRE)) );
+	uint8_t next = (tx_head + 1) & TX_MASK;
 
-	// Put data into buffer, send the character
-	UDR = data;
+	while (next == tx_tail) {
+		// buffer is full
+		if (tx_overflow == UART_DROP) {
+			tx_dropped++;
+			return;
+		}
+		// with interrupts disabled the buffer would never drain by itself
+		if (!hal_irq_enabled()) tx_poll();
+	}
+	tx_buf[tx_head] = data;
+	tx_head = next;
+	hal_uart_udre_irq(true);
 }
 
 void UART_send_buf(uint8_t *buf, size_t len)
@@ -45,3 +79,72 @@ void UART_send_strn(char *str, size_t n) {
 		UART_transmit(str[i]);
 	}
 }
+
+bool UART_tx_busy()
+{
+	return tx_head != tx_tail || !hal_uart_tx_done();
+}
+
+uint16_t UART_dropped()
+{
+	return tx_dropped;
+}
+
+bool UART_receive(uint8_t *data)
+{
+	if (rx_head == rx_tail) return false;
+	*data = rx_buf[rx_tail];
+	rx_tail = (rx_tail + 1) & RX_MASK;
+	return true;
+}
+
+bool UART_rx_pending()
+{
+	return rx_head != rx_tail;
+}
+
+uint16_t UART_rx_errors()
+{
+	uint16_t errors;
+
+	// the counter is wider than a byte, so read it atomically
+	if (hal_irq_enabled()) {
+		hal_irq_disable();
+		errors = rx_errors;
+		hal_irq_enable();
+	} else {
+		errors = rx_errors;
+	}
+	return errors;
+}
+
+ISR(USART_UDRE_vect)
+{
+	const uint16_t start = profile_start();
+
+	if (tx_head == tx_tail) {
+		// nothing left to send
+		hal_uart_udre_irq(false);
+	} else {
+		hal_uart_write(tx_buf[tx_tail]);
+		tx_tail = (tx_tail + 1) & TX_MASK;
+	}
+	profile_end(PROFILE_USART_UDRE, start);
+}
+
+ISR(USART_RXC_vect)
+{
+	const uint16_t start = profile_start();
+	// the error flags are only valid before the data is read
+	const bool error = hal_uart_rx_error();
+	const uint8_t data = hal_uart_read();
+	const uint8_t next = (rx_head + 1) & RX_MASK;
+
+	if (error || next == rx_tail) {
+		rx_errors++;
+	} else {
+		rx_buf[rx_head] = data;
+		rx_head = next;
+	}
+	profile_end(PROFILE_USART_RXC, start);
+}
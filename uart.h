@@ -1,12 +1,39 @@
 #ifndef UART_H_
 #define UART_H_
 
-#include <avr/io.h>
-#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Transmitted bytes are queued in a ring buffer of UART_TX_BUFFER_SIZE bytes
+ * (a power of two), which is drained by the USART_UDRE interrupt. When the
+ * buffer is full, the overflow policy decides whether the byte is dropped or
+ * whether we wait for room.
+ */
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 128
+#endif /* UART_TX_BUFFER_SIZE */
+
+/*
+ * Received bytes are queued by the USART_RXC interrupt in a ring buffer of
+ * UART_RX_BUFFER_SIZE bytes (a power of two) until UART_receive picks them up.
+ */
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 32
+#endif /* UART_RX_BUFFER_SIZE */
+
+enum uart_overflow {
+	UART_DROP,  // drop the byte and count it in UART_dropped()
+	UART_BLOCK  // wait until there is room in the buffer
+};
 
 // Will init with a baud rate of 9600
 void UART_init();
 
+// Choose what happens when the transmit buffer is full (default: UART_BLOCK)
+void UART_set_overflow(enum uart_overflow policy);
+
 // Send one character
 void UART_transmit(unsigned char data);
 
@@ -17,4 +44,20 @@ void UART_send_buf(uint8_t *buf, size_t len);
 void UART_send_str(char *str);
 void UART_send_strn(char *str, size_t n);
 
+// Is the transmitter still sending?
+bool UART_tx_busy();
+
+// Number of bytes that were dropped because the buffer was full
+uint16_t UART_dropped();
+
+// Take the oldest received byte, returns false if there is none
+bool UART_receive(uint8_t *data);
+
+// Are there received bytes waiting?
+bool UART_rx_pending();
+
+// Number of received bytes that were lost (framing errors, overruns or a full
+// buffer)
+uint16_t UART_rx_errors();
+
 #endif /* UART_H_ */